@@ -0,0 +1,309 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+/*
+ * Microbenchmarks of the hot paths.
+ * Every benchmark is repeated until it runs for a minimum time, reported
+ * are time and heap allocations per operation. Input data are generated
+ * from a fixed seed, so results of different builds are comparable.
+ */
+
+#include "classifier.hpp"
+#include "timer.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+using std::string;
+
+// heap allocation counters (benchmarks are single-threaded)
+static size_t alloc_count = 0, alloc_bytes = 0;
+// called through a pointer, so that the compiler does not pair inlined new/delete with malloc/free
+static void* (*volatile allocate)(size_t) = std::malloc;
+static void (*volatile release)(void*) = std::free;
+
+void* operator new(size_t size)
+{
+    ++alloc_count;
+    alloc_bytes += size;
+    void* p = allocate(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() { release(p); }
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* p) throw() { operator delete(p); }
+
+/// benchmark result
+struct BenchResult {
+    string name, args;
+    size_t ops;
+    double ns_per_op, allocs_per_op, bytes_per_op;
+    double items_per_op; ///< processed items (samples, frames) per operation
+};
+
+/// benchmark operation
+struct Bench {
+    virtual ~Bench() {}
+    virtual void run() = 0;
+};
+
+/// benchmark settings
+struct BenchParams {
+    double min_time;   ///< minimum measured time of a benchmark
+    string filter;     ///< run only benchmarks containing this string
+    std::vector<BenchResult> results;
+};
+
+/// measure an operation
+void measure(BenchParams& p, const string& name, const string& args, Bench& b, double items = 1.0)
+{
+    if (!p.filter.empty() && (name + " " + args).find(p.filter) == string::npos) return;
+
+    b.run(); // warm up
+    size_t ops = 0, batch = 1;
+    size_t allocs = alloc_count, bytes = alloc_bytes;
+    double t = wall_time(), elapsed = 0.0;
+    while (elapsed < p.min_time) {
+        for (size_t i = 0; i < batch; ++i) b.run();
+        ops += batch;
+        elapsed = wall_time() - t;
+        if (elapsed < p.min_time / 10) batch *= 2;
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.args = args;
+    r.ops = ops;
+    r.ns_per_op = 1e9 * elapsed / ops;
+    r.allocs_per_op = double(alloc_count - allocs) / ops;
+    r.bytes_per_op = double(alloc_bytes - bytes) / ops;
+    r.items_per_op = items;
+    p.results.push_back(r);
+
+    std::cout << std::left << std::setw(34) << name << std::setw(18) << args << std::right
+              << std::setw(14) << std::fixed << std::setprecision(1) << r.ns_per_op
+              << std::setw(14) << std::setprecision(0) << items * 1e9 / r.ns_per_op
+              << std::setw(10) << std::setprecision(1) << r.allocs_per_op
+              << std::setw(12) << std::setprecision(0) << r.bytes_per_op << std::endl;
+}
+
+/// random data generator
+boost::mt19937 rng(42);
+boost::normal_distribution<Real> normal_dist(0.0, 1.0);
+boost::variate_generator<boost::mt19937&, boost::normal_distribution<Real> > normal(rng, normal_dist);
+
+NNLayer::Vector random_vector(size_t n)
+{
+    NNLayer::Vector v(n);
+    for (size_t i = 0; i < n; ++i) v[i] = normal();
+    return v;
+}
+
+/// dataset of random samples
+DataSet random_dataset(size_t n, size_t in, size_t out)
+{
+    DataSet d;
+    for (size_t i = 0; i < n; ++i) d.add_sample(random_vector(in), random_vector(out));
+    return d;
+}
+
+struct LayerExec : Bench {
+    NNLayer& l; NNLayer::Vector in;
+    LayerExec(NNLayer& l, const NNLayer::Vector& in) : l(l), in(in) {}
+    void run() { l.exec(in); }
+};
+
+struct NetExec : Bench {
+    NeuralNet& nn; NNLayer::Vector in;
+    NetExec(NeuralNet& nn, const NNLayer::Vector& in) : nn(nn), in(in) {}
+    void run() { nn.exec(in); }
+};
+
+struct PlanExec : Bench {
+    InferencePlan plan; NNLayer::Vector in;
+    PlanExec(const InferencePlan& plan, const NNLayer::Vector& in) : plan(plan), in(in) {}
+    void run() { plan.exec(in); }
+};
+
+struct NetSample : Bench {
+    NeuralNet::Teacher& t; NNLayer::Vector in, out;
+    NetSample(NeuralNet::Teacher& t, const NNLayer::Vector& in, const NNLayer::Vector& out) : t(t), in(in), out(out) {}
+    void run() { t.sample(in, out); }
+};
+
+struct LayerTeach : Bench {
+    NNLayer::Teacher& t; NNLayer::Vector in, out, dout;
+    LayerTeach(NNLayer::Teacher& t, const NNLayer::Vector& in, const NNLayer::Vector& out, const NNLayer::Vector& dout) :
+        t(t), in(in), out(out), dout(dout) {}
+    void run() { t.sample(in, out, dout); t.teach(1e-6); }
+};
+
+struct FeatureBench : Bench {
+    const Features& f; size_t i;
+    explicit FeatureBench(const Features& f) : f(f), i(0) {}
+    void run() { f.feature(i); i = (i + 1) % f.frames(); }
+};
+
+struct WriteTmp : Bench {
+    const DataSet& d; string file;
+    WriteTmp(const DataSet& d, const string& file) : d(d), file(file) {}
+    void run() { d.write_tmp(file); }
+};
+
+struct LoadTmp : Bench {
+    string file;
+    explicit LoadTmp(const string& file) : file(file) {}
+    void run() { DataSet d; d.load_tmp(file); }
+};
+
+struct Normalize : Bench {
+    const DataSet& d; DataSet::DataSampleList buf;
+    explicit Normalize(const DataSet& d) : d(d) {}
+    void run()
+    {
+        DataSet n(d);
+        n.normalize_all();
+        for (size_t b = 0; b < n.blocks(); ++b) n.block(b, buf);
+    }
+};
+
+struct ClassifierExec : Bench {
+    const Classifier& c; const DataSet& d;
+    ClassifierExec(const Classifier& c, const DataSet& d) : c(c), d(d) {}
+    void run() { c.exec(d); }
+};
+
+/// write results as JSON
+void write_json(const BenchParams& p, std::ostream& os)
+{
+    os << "{\n  \"min_time\": " << p.min_time << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < p.results.size(); ++i) {
+        const BenchResult& r = p.results[i];
+        os << "    {\"name\": \"" << r.name << "\", \"args\": \"" << r.args << "\", \"ops\": " << r.ops
+           << std::setprecision(6) << std::fixed
+           << ", \"ns_per_op\": " << r.ns_per_op << ", \"items_per_s\": " << r.items_per_op * 1e9 / r.ns_per_op
+           << ", \"allocs_per_op\": " << r.allocs_per_op << ", \"bytes_per_op\": " << r.bytes_per_op << "}"
+           << (i + 1 < p.results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    BenchParams p;
+    p.min_time = 0.5;
+    string json;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string str = argv[i];
+                 if (str == "-o" && i + 1 < argc) json = argv[++i];
+            else if (str == "-t" && i + 1 < argc) p.min_time = boost::lexical_cast<double>(argv[++i]);
+            else if (str == "-f" && i + 1 < argc) p.filter = argv[++i];
+            else {
+                std::cout << argv[0] << " [-o <results.json>] [-t <min_seconds>] [-f <name_filter>]" << std::endl;
+                return 1;
+            }
+        }
+
+        const size_t inputs = 30, outputs = 5;
+        const size_t hidden[] = { 10, 50, 200 };
+        boost::filesystem::path tmp = boost::filesystem::temp_directory_path()
+                                    / boost::filesystem::unique_path("genre_bench-%%%%-%%%%");
+
+        std::cout << std::left << std::setw(34) << "benchmark" << std::setw(18) << "args" << std::right
+                  << std::setw(14) << "ns/op" << std::setw(14) << "items/s" << std::setw(10) << "allocs"
+                  << std::setw(12) << "bytes" << std::endl;
+
+        for (size_t h = 0; h < sizeof(hidden) / sizeof(hidden[0]); ++h) {
+            string args = boost::lexical_cast<string>(inputs) + "-" + boost::lexical_cast<string>(hidden[h])
+                        + "-" + boost::lexical_cast<string>(outputs);
+            NNLayer::Vector in = random_vector(inputs), out = random_vector(outputs);
+
+            NNLayer layer(inputs, hidden[h], sigmoid_func);
+            layer.randomize();
+            LayerExec le(layer, in);
+            measure(p, "NNLayer::exec", args, le);
+
+            NeuralNet nn(inputs, hidden[h], outputs, sigmoid_func, logsigmoid_func);
+            NeuralNet::Teacher nt(nn);
+            NetExec ne(nn, in);
+            measure(p, "NeuralNet::exec", args, ne);
+            NetSample ns(nt, in, out);
+            measure(p, "NeuralNet::Teacher::sample", args, ns);
+
+            NNLayer::Vector mean = boost::numeric::ublas::zero_vector<Real>(inputs);
+            NNLayer::Vector stddev = boost::numeric::ublas::scalar_vector<Real>(inputs, 1.0);
+            PlanExec pe(InferencePlan(nn, mean, stddev), in);
+            measure(p, "InferencePlan::exec", args, pe);
+            NeuralNet pruned = nn;
+            pruned.prune(0.9);
+            PlanExec pse(InferencePlan(pruned, mean, stddev), in);
+            measure(p, "InferencePlan::exec", args + " 90% zero", pse);
+
+            NNLayer::Teacher lt(layer);
+            NNLayer::Vector lout = layer.exec(in), dout = random_vector(hidden[h]);
+            LayerTeach lteach(lt, in, lout, dout);
+            measure(p, "NNLayer::Teacher::sample+teach", args, lteach);
+
+            DataSet record = random_dataset(300, inputs, outputs);
+            Classifier c;
+            LabelList labels(outputs, "label");
+            Classifier::Teacher ct(c, nn, labels, record, record, record);
+            ClassifierExec ce(c, record);
+            measure(p, "Classifier::exec(DataSet)", args + " x300", ce, record.count());
+        }
+
+        // features of a synthetic record (10 s of noisy tones)
+        {
+            std::vector<short> samples(22050 * 10);
+            for (size_t i = 0; i < samples.size(); ++i)
+                samples[i] = static_cast<short>(8000 * std::sin(i * 0.05) + 3000 * std::sin(i * 0.31) + 500 * normal());
+            string wav = tmp.string() + ".wav";
+            Features::write_wave(wav, 22050, samples);
+            Features f(wav);
+            boost::filesystem::remove(wav);
+            FeatureBench fb(f);
+            measure(p, "Features::feature", "22050Hz", fb);
+        }
+
+        // dataset I/O and normalization
+        {
+            DataSet d = random_dataset(2000, inputs, outputs);
+            string file = tmp.string() + ".dat";
+            WriteTmp w(d, file);
+            measure(p, "DataSet::write_tmp", "2000x30", w, d.count());
+            LoadTmp l(file);
+            measure(p, "DataSet::load_tmp", "2000x30", l, d.count());
+            boost::filesystem::remove(file);
+            Normalize n(d);
+            measure(p, "DataSet::normalize_all+blocks", "2000x30", n, d.count());
+        }
+
+        if (!json.empty()) {
+            std::ofstream ofs(json.c_str());
+            write_json(p, ofs);
+            if (!ofs) throw std::runtime_error("Unable to write " + json);
+        }
+    } catch (std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
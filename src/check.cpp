@@ -0,0 +1,267 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+/*
+ * Consistency checks of the compact data paths: encoded data streams must
+ * decode within the error bound of their encoding, folding the input
+ * normalization into the first layer must not change classifier outputs and
+ * full-batch training on a stream must not depend on the number of processes.
+ * Input data are generated from a fixed seed, the exit status is nonzero
+ * if any check fails.
+ */
+
+#include "classifier.hpp"
+#include "cluster.hpp"
+#include "datastream.hpp"
+#include "inference.hpp"
+#include "modelfile.hpp"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/filesystem.hpp>
+
+using std::string;
+
+const Real HALF_EPS = 1.0 / 2048 + 1.0 / 16777216; // relative rounding error of a 16-bit float (through a single precision one)
+const Real INT16_STEP = 1.0 / 32767;               // quantization step of an int16 code relative to the block scale
+const Real ROUNDOFF = 1e-9;                        // relative error of normalization and of the folded arithmetic
+
+/// random data generator
+boost::mt19937 rng(42);
+boost::normal_distribution<Real> normal_dist(0.0, 1.0);
+boost::variate_generator<boost::mt19937&, boost::normal_distribution<Real> > normal(rng, normal_dist);
+
+/// number of failed checks
+static size_t failures = 0;
+
+/// report a check
+void report(const string& name, bool ok, Real worst, Real bound)
+{
+    std::cout << std::left << std::setw(44) << name << std::right << std::scientific << std::setprecision(3)
+              << std::setw(14) << worst << std::setw(14) << bound << "  " << (ok ? "ok" : "FAILED") << std::endl;
+    if (!ok) ++failures;
+}
+
+/// random input of dimensions of very different magnitudes (as features and their deltas)
+FeatureVector random_input(size_t n)
+{
+    static const Real scales[] = { 1.0, 1e-3, 1e-6, 1e3 };
+    FeatureVector v(n);
+    for (size_t i = 0; i < n; ++i) v(i) = scales[i % 4] * (normal() + i);
+    return v;
+}
+
+/// unnormalized inputs of a stream by sample index (the only output element)
+std::vector<FeatureVector> read_stream(const string& file)
+{
+    DataStream s(file);
+    FeatureVector m = s.mean(), d = s.stddev();
+    std::vector<FeatureVector> samples(s.count());
+    SampleSource::DataSampleList buf;
+    for (size_t b = 0; b < s.blocks(); ++b) {
+        const SampleSource::DataSampleList& blk = s.block(b, buf);
+        for (size_t i = 0; i < blk.size(); ++i)
+            samples[static_cast<size_t>(blk[i].second(0))] = element_prod(blk[i].first, d) + m;
+    }
+    return samples;
+}
+
+/// largest error of decoded samples relative to the error bound of every dimension
+Real worst_error(const std::vector<FeatureVector>& a, const std::vector<FeatureVector>& b, const FeatureVector& bound)
+{
+    Real worst = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        for (size_t j = 0; j < bound.size(); ++j) worst = std::max(worst, std::fabs(a[i](j) - b[i](j)) / bound(j));
+    return worst;
+}
+
+/// encode and decode random samples by every encoding, then append to the streams
+void check_streams(const string& tmp)
+{
+    const size_t n = 3000, dims = 8, block_size = 512;
+    std::vector<FeatureVector> samples(n + n / 10);
+    for (size_t i = 0; i < samples.size(); ++i) samples[i] = random_input(dims);
+
+    // appended samples complete the partial last block in its range (between two of its samples)
+    const size_t last = n / block_size * block_size;
+    for (size_t i = n; i < samples.size(); ++i) samples[i] = (samples[last + i - n] + samples[last + i - n + 1]) / 2;
+
+    FeatureVector range(dims);
+    for (size_t j = 0; j < dims; ++j) {
+        Real lo = samples[0](j), hi = samples[0](j);
+        for (size_t i = 1; i < n; ++i) {
+            lo = std::min(lo, samples[i](j));
+            hi = std::max(hi, samples[i](j));
+        }
+        range(j) = hi - lo;
+    }
+
+    const DataStream::Encoding encodings[] = { DataStream::REAL, DataStream::HALF, DataStream::INT16 };
+    const char* names[] = { "real", "half", "int16" };
+    for (size_t e = 0; e < 3; ++e) {
+        // a value is mapped to [-1, 1] by at most half the range of its block and dimension
+        FeatureVector bound(dims);
+        for (size_t j = 0; j < dims; ++j) {
+            Real scale = range(j) / 2;
+            Real err = (encodings[e] == DataStream::HALF ? scale * HALF_EPS
+                      : encodings[e] == DataStream::INT16 ? scale * INT16_STEP / 2 : 0.0);
+            bound(j) = err + ROUNDOFF * (range(j) + std::fabs(samples[0](j)));
+        }
+
+        string file = tmp + "-" + names[e] + ".dat";
+        FeatureVector out(1);
+        {
+            DataStream::Writer w(file, false, encodings[e], block_size, 0);
+            for (size_t i = 0; i < n; ++i) {
+                out(0) = i;
+                w.add_sample(samples[i], out);
+            }
+            w.close();
+        }
+        std::vector<FeatureVector> stored = read_stream(file);
+        std::vector<FeatureVector> original(samples.begin(), samples.begin() + n);
+        Real worst = worst_error(stored, original, bound);
+        report(string("stream round trip, ") + names[e], worst <= 1.0, worst, 1.0);
+
+        // samples of the partial block must not be quantized again by appending
+        {
+            DataStream::Writer w(file, true, encodings[e], block_size, 0);
+            for (size_t i = n; i < samples.size(); ++i) {
+                out(0) = i;
+                w.add_sample(samples[i], out);
+            }
+            w.close();
+        }
+        std::vector<FeatureVector> appended = read_stream(file);
+        std::vector<FeatureVector> old(appended.begin(), appended.begin() + n), added(appended.begin() + n, appended.end());
+        std::vector<FeatureVector> expected(samples.begin() + n, samples.end());
+        FeatureVector exact = bound;
+        for (size_t j = 0; j < dims; ++j) exact(j) = ROUNDOFF * (range(j) + std::fabs(samples[0](j)));
+        worst = worst_error(old, stored, exact);
+        report(string("stored samples kept by append, ") + names[e], worst <= 1.0, worst, 1.0);
+        worst = worst_error(added, expected, bound);
+        report(string("appended round trip, ") + names[e], worst <= 1.0, worst, 1.0);
+        boost::filesystem::remove(file);
+    }
+}
+
+/// largest relative difference of two plans' outputs
+Real plan_difference(const InferencePlan& a, const InferencePlan& b, const std::vector<FeatureVector>& inputs)
+{
+    Real worst = 0.0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        InferencePlan::Vector x = a.exec(inputs[i]), y = b.exec(inputs[i]);
+        for (size_t o = 0; o < x.size(); ++o)
+            worst = std::max(worst, std::fabs(x(o) - y(o)) / std::max<Real>(1.0, std::fabs(y(o))));
+    }
+    return worst;
+}
+
+/// compare plans with folded normalization to the mapped model normalizing every frame
+void check_folding(const string& tmp)
+{
+    const size_t inputs = 30, hidden = 50, outputs = 5;
+    std::vector<FeatureVector> frames(200);
+    for (size_t i = 0; i < frames.size(); ++i) frames[i] = random_input(inputs);
+    FeatureVector mean = boost::numeric::ublas::zero_vector<Real>(inputs), stddev(inputs);
+    for (size_t i = 0; i < frames.size(); ++i) mean += frames[i] / Real(frames.size());
+    for (size_t j = 0; j < inputs; ++j) {
+        stddev(j) = 0.0;
+        for (size_t i = 0; i < frames.size(); ++i) stddev(j) += std::fabs(frames[i](j) - mean(j)) / frames.size();
+    }
+    LabelList labels(outputs, "label");
+
+    for (int pruned = 0; pruned < 2; ++pruned) {
+        NeuralNet nn(inputs, hidden, outputs, sigmoid_func, logsigmoid_func);
+        NeuralNet::Teacher t(nn);
+        if (pruned) nn.prune(0.9); // evaluated by the sparse kernel
+
+        string file = tmp + ".model";
+        ModelFile::write(file, labels, mean, stddev, nn);
+        Real worst;
+        {
+            ModelFile model(file, true);
+            worst = plan_difference(InferencePlan(nn, mean, stddev), model.plan(), frames);
+        }
+        boost::filesystem::remove(file);
+        report(pruned ? "folded normalization, 90% zero" : "folded normalization", worst <= ROUNDOFF, worst, ROUNDOFF);
+    }
+}
+
+/// train a network on a stream by full-batch iRPROP+, in one process or a cluster (rank 0 gets the result)
+NeuralNet batch_train(const string& file, const NeuralNet& init, Cluster* cluster)
+{
+    DataStream data(file);
+    LabelList labels(data.output_size(), "label");
+    Classifier c;
+    Classifier::Teacher t(c, init, labels, data, data, data, false);
+    t.set_log(0);
+    t.set_cluster(cluster);
+    t.set_batch(BatchOptimizer::RPROP);
+    t.teach(0, 0.1);
+    return c.neural_net();
+}
+
+/**
+ * compare full-batch training on a stream by one and two processes, every process sums
+ * the gradient over its slice of every block (false in the second process, which has to quit)
+ */
+bool check_cluster(const string& tmp)
+{
+    const size_t n = 3000, dims = 6, classes = 3, block_size = 512;
+    string file = tmp + "-cluster.dat";
+    {
+        DataStream::Writer w(file, false, DataStream::REAL, block_size);
+        for (size_t i = 0; i < n; ++i) {
+            FeatureVector in = random_input(dims), out = boost::numeric::ublas::zero_vector<Real>(classes);
+            in(i % dims) += 3.0 * (i % classes);
+            out(i % classes) = 1.0;
+            w.add_sample(in, out);
+        }
+        w.close();
+    }
+    NeuralNet init(dims, 8, classes, sigmoid_func, logsigmoid_func);
+    NeuralNet::Teacher randomize(init);
+
+    NeuralNet single = batch_train(file, init, 0);
+    std::auto_ptr<Cluster> cluster = Cluster::spawn(2);
+    NeuralNet parallel = batch_train(file, init, cluster.get());
+    if (cluster->rank() > 0) return false;
+    cluster.reset();
+    boost::filesystem::remove(file);
+
+    std::vector<Real> a, b;
+    single.get_weights(a);
+    parallel.get_weights(b);
+    Real worst = (a.size() == b.size() ? 0.0 : 1.0);
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        worst = std::max(worst, std::fabs(a[i] - b[i]) / std::max<Real>(1.0, std::fabs(a[i])));
+    report("batch training, 1 and 2 processes", worst <= ROUNDOFF, worst, ROUNDOFF);
+    return true;
+}
+
+int main()
+{
+    try {
+        boost::filesystem::path tmp = boost::filesystem::temp_directory_path()
+                                    / boost::filesystem::unique_path("genre_check-%%%%-%%%%");
+        std::cout << std::left << std::setw(44) << "check" << std::right << std::setw(14) << "worst"
+                  << std::setw(14) << "bound" << std::endl;
+        check_streams(tmp.string());
+        check_folding(tmp.string());
+        if (!check_cluster(tmp.string())) return 0;
+    } catch (std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -6,24 +6,40 @@
  */
 
 #include "classifier.hpp"
+#include "profile.hpp"
+#include "cluster.hpp"
+#include "projection.hpp"
 #include <boost/numeric/ublas/vector_proxy.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/random_number_generator.hpp>
 
 using namespace boost::numeric::ublas;
 
 const char LABEL_DELIM[] = ";";
+const char ENSEMBLE_MAGIC[] = "ensemble";
 
-Classifier::Classifier() {}
+Classifier::Classifier() : combination(InferencePlan::MEAN) {}
 
 Classifier::Vector Classifier::exec(const Vector& in) const
 {
-    return nn.exec(element_div(in - mean(), stddev()));
+    return plan.exec(in);
 }
 
 Classifier::Vector Classifier::exec(const DataSet& data) const
 {
+    Profile::Scope scope("inference");
+    Profile::count("inferred frames", data.count());
     Vector sum = zero_vector<Real>(labels_.size());
     for (size_t i = 0; i < data.count(); ++i)
         sum += exec(data.sample(i).first);
@@ -31,25 +47,301 @@ Classifier::Vector Classifier::exec(const DataSet& data) const
     return element_div(sum, scalar_vector<Real>(sum.size(), data.count()));
 }
 
+std::vector<Classifier::Vector> Classifier::exec(const DataSet& data, size_t window, size_t hop) const
+{
+    std::vector<Vector> result;
+    size_t n = data.count();
+    if (n == 0) return result;
+    window = std::min(std::max<size_t>(window, 1), n);
+    hop = std::max<size_t>(hop, 1);
+
+    // every frame is classified once, window sums are updated by the frames entering and leaving
+    std::vector<Vector> frames(n);
+    {
+        Profile::Scope scope("inference");
+        Profile::count("inferred frames", n);
+        for (size_t i = 0; i < n; ++i) frames[i] = exec(data.sample(i).first);
+    }
+
+    Vector sum = zero_vector<Real>(frames[0].size());
+    size_t lo = 0, hi = 0; // frames in the sum
+    for (size_t start = 0; start + window <= n; start += hop) {
+        if (start >= hi) {
+            // windows do not overlap
+            sum.clear();
+            lo = hi = start;
+        }
+        for (; hi < start + window; ++hi) sum += frames[hi];
+        for (; lo < start; ++lo) sum -= frames[lo];
+        result.push_back(sum / window);
+    }
+    return result;
+}
+
 Real Classifier::error(const Vector& in, const Vector& out) const
 {
-    Vector err = out - exec(in);
+    // datasets are normalized already
+    Vector res;
+    if (!nn.get_layers().empty()) res = nn.exec(in);
+    else if (!plan.folded()) res = plan.exec(in, true);
+    else if (members_.empty()) res = plan.exec(element_prod(in, stddev_) + mean_); // mapped model, undo the normalization
+    else throw std::logic_error("Ensemble members have their own normalization, evaluate raw frames");
+    Vector err = out - res;
     return sum(element_prod(err, err)); // err^2
 }
 
-Real Classifier::error(const DataSet& data) const
+Real Classifier::error(const SampleSource& data, size_t part, size_t parts) const
 {
+    std::vector<size_t> order(data.blocks());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+
+    // every ensemble member normalizes raw frames by its own statistics,
+    // the normalization of the data is undone for them
+    bool raw = !members_.empty();
+    Vector m = data.mean(), s = data.stddev();
+
     Real err = 0.0;
-    for (size_t i = 0; i < data.count(); ++i)
-        err += error(data.sample(i).first, data.sample(i).second);
+    Prefetcher loader(data, order);
+    while (const SampleSource::DataSampleList* blk = loader.next())
+        for (size_t i = blk->size() * part / parts; i < blk->size() * (part + 1) / parts; ++i) {
+            const SampleSource::DataSample& x = (*blk)[i];
+            if (!raw) err += error(x.first, x.second);
+            else {
+                Vector d = x.second - plan.exec(element_prod(x.first, s) + m);
+                err += sum(element_prod(d, d));
+            }
+        }
     return err;
 }
 
+void Classifier::soft_targets(const SampleSource& data, DataSet& out) const
+{
+    Profile::Scope scope("inference");
+    Profile::count("inferred frames", data.count());
+    std::vector<size_t> order(data.blocks());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+
+    // the data are normalized by their own statistics, the classifier normalizes raw frames by its own
+    Vector m = data.mean(), s = data.stddev();
+    Prefetcher loader(data, order);
+    while (const SampleSource::DataSampleList* blk = loader.next())
+        for (size_t i = 0; i < blk->size(); ++i) {
+            Vector raw = element_prod((*blk)[i].first, s) + m;
+            out.add_sample(raw, exec(raw));
+        }
+}
+
 void Classifier::load(std::istream& is)
 {
     std::string str;
     is >> str >> mean_ >> stddev_ >> nn;
     boost::algorithm::split(labels_, str, boost::algorithm::is_any_of(LABEL_DELIM));
+    model.reset();
+    members_.clear();
+    prepare();
+}
+
+void Classifier::prepare()
+{
+    if (!members_.empty()) {
+        std::vector<InferencePlan> plans;
+        std::vector<Real> weights;
+        for (size_t m = 0; m < members_.size(); ++m) {
+            plans.push_back(members_[m]->plan);
+            weights.push_back(member_errors[m] > 0.0 ? 1.0 / member_errors[m] : 1.0);
+        }
+        plan = InferencePlan::stack(plans, weights, combination);
+    }
+    else if (model) plan = model->plan();
+    else if (nn.get_layers().empty()) plan = InferencePlan();
+    else plan = InferencePlan(nn, mean_, stddev_);
+}
+
+void Classifier::load_file(const std::string& filename, bool map, bool verify)
+{
+    Profile::Scope scope("model load");
+    if (is_ensemble(filename)) {
+        std::vector<std::string> files;
+        std::vector<Real> errors;
+        read_ensemble(filename, files, errors);
+        load_ensemble(files, errors, InferencePlan::MEAN, verify);
+        return;
+    }
+    if (!ModelFile::is_model(filename)) {
+        std::ifstream ifs(filename.c_str());
+        if (!ifs) throw std::runtime_error("Unable to open model " + filename);
+        load(ifs);
+        return;
+    }
+
+    members_.clear();
+    boost::shared_ptr<const ModelFile> m(new ModelFile(filename, verify));
+    labels_ = m->labels();
+    mean_.resize(m->input_size());
+    stddev_.resize(m->input_size());
+    std::copy(m->mean(), m->mean() + m->input_size(), mean_.begin());
+    std::copy(m->stddev(), m->stddev() + m->input_size(), stddev_.begin());
+    if (map) {
+        nn = NeuralNet();
+        model = m;
+    } else {
+        nn = m->network();
+        model.reset();
+    }
+    prepare();
+}
+
+void Classifier::load_ensemble(const std::vector<std::string>& files, const std::vector<Real>& errors, InferencePlan::Combination c,
+                               bool verify)
+{
+    if (files.empty()) throw std::runtime_error("Empty ensemble");
+
+    std::vector<boost::shared_ptr<const Classifier> > members;
+    for (size_t i = 0; i < files.size(); ++i) {
+        boost::shared_ptr<Classifier> m(new Classifier);
+        m->load_file(files[i], true, verify);
+        if (m->members() != 1) throw std::runtime_error("Ensemble member is not a single network: " + files[i]);
+        if (!members.empty() && m->labels() != members[0]->labels())
+            throw std::runtime_error("Ensemble member labels differ: " + files[i]);
+        members.push_back(m);
+    }
+
+    members_.swap(members);
+    member_errors = errors;
+    member_errors.resize(members_.size(), 0.0);
+    combination = c;
+    labels_ = members_[0]->labels_;
+    // informative only, the stacked plan normalizes inputs of every member by its own statistics
+    mean_ = members_[0]->mean_;
+    stddev_ = members_[0]->stddev_;
+    nn = NeuralNet();
+    model.reset();
+    prepare();
+}
+
+void Classifier::set_combination(InferencePlan::Combination c)
+{
+    combination = c;
+    prepare();
+}
+
+bool Classifier::is_ensemble(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str());
+    std::string word;
+    return (ifs >> word) && word == ENSEMBLE_MAGIC;
+}
+
+void Classifier::read_ensemble(const std::string& filename, std::vector<std::string>& files, std::vector<Real>& errors)
+{
+    std::ifstream ifs(filename.c_str());
+    std::string line, name;
+    if (!getline(ifs, line) || line != ENSEMBLE_MAGIC) throw std::runtime_error("Not an ensemble list: " + filename);
+
+    // member paths are relative to the list
+    boost::filesystem::path dir = boost::filesystem::path(filename).parent_path();
+    files.clear();
+    errors.clear();
+    while (getline(ifs, line)) {
+        if (line.empty()) continue;
+        std::istringstream is(line);
+        Real err;
+        if (!(is >> err) || !getline(is >> std::ws, name)) throw std::runtime_error("Malformed ensemble list " + filename);
+        boost::filesystem::path p(name);
+        files.push_back((p.is_absolute() ? p : dir / p).string());
+        errors.push_back(err);
+    }
+}
+
+void Classifier::write_ensemble(const std::string& filename, const std::vector<std::string>& files, const std::vector<Real>& errors)
+{
+    std::ofstream ofs(filename.c_str());
+    if (!ofs) throw std::runtime_error("Unable to write " + filename);
+    ofs << ENSEMBLE_MAGIC << std::endl;
+    for (size_t i = 0; i < files.size(); ++i)
+        ofs << (i < errors.size() ? errors[i] : 0.0) << ' ' << files[i] << std::endl;
+}
+
+void Classifier::prune(Real fraction, const SampleSource* data)
+{
+    const size_t max_samples = 20000; // enough for input magnitudes
+    if (!members_.empty() || nn.get_layers().empty()) throw std::runtime_error("Only a single network can be pruned");
+
+    // root mean square of the inputs of every layer
+    std::vector<Vector> scales;
+    if (data && data->count()) {
+        const NeuralNet::LayerArray& layers = nn.get_layers();
+        for (size_t l = 0; l < layers.size(); ++l) scales.push_back(zero_vector<Real>(layers[l].no_inputs()));
+        size_t n = 0;
+        SampleSource::DataSampleList buf;
+        for (size_t b = 0; b < data->blocks() && n < max_samples; ++b) {
+            const SampleSource::DataSampleList& blk = data->block(b, buf);
+            for (size_t i = 0; i < blk.size() && n < max_samples; ++i, ++n) {
+                Vector x = blk[i].first;
+                for (size_t l = 0; l < layers.size(); ++l) {
+                    scales[l] += element_prod(x, x);
+                    x = layers[l].exec(x);
+                }
+            }
+        }
+        for (size_t l = 0; l < scales.size(); ++l)
+            for (size_t i = 0; i < scales[l].size(); ++i) scales[l](i) = std::sqrt(scales[l](i) / n);
+    }
+
+    nn.prune(fraction, scales);
+    prepare();
+}
+
+NeuralNet Classifier::renormalized(const Vector& mean, const Vector& stddev) const
+{
+    if (!members_.empty() || nn.get_layers().empty()) throw std::runtime_error("Only a single network can be trained further");
+    if (mean.size() != mean_.size() || stddev.size() != stddev_.size()) throw std::runtime_error("Input size does not match the network");
+
+    // an input normalized by the classifier is u = (x - mean_) / stddev_ and x = v * stddev + mean,
+    // so u = v * stddev / stddev_ + (mean - mean_) / stddev_
+    const NeuralNet::LayerArray& layers = nn.get_layers();
+    NeuralNet::Matrix w = layers[0].weight_matrix();
+    for (size_t i = 0; i < mean.size(); ++i) {
+        if (stddev_(i) == 0.0) continue;
+        Real scale = stddev(i) / stddev_(i), shift = (mean(i) - mean_(i)) / stddev_(i);
+        for (size_t o = 0; o < w.size2(); ++o) {
+            w(0, o) += w(i + 1, o) * shift;
+            w(i + 1, o) *= scale;
+        }
+    }
+
+    NeuralNet result;
+    for (size_t l = 0; l < layers.size(); ++l) {
+        NNLayer layer(l == 0 ? w : layers[l].weight_matrix(), layers[l].activation());
+        result.add_layer(layer);
+    }
+    return result;
+}
+
+void Classifier::prepend(const Projection& p)
+{
+    if (!members_.empty() || nn.get_layers().empty()) throw std::runtime_error("Only a single network can be projected");
+    if (p.output_size() != mean_.size()) throw std::runtime_error("Projection does not match the network inputs");
+
+    NeuralNet result;
+    NNLayer first = p.layer(mean_, stddev_);
+    result.add_layer(first);
+    const NeuralNet::LayerArray& layers = nn.get_layers();
+    for (size_t l = 0; l < layers.size(); ++l) {
+        NNLayer layer(layers[l].weight_matrix(), layers[l].activation());
+        result.add_layer(layer);
+    }
+    nn = result;
+    mean_ = p.mean();
+    stddev_ = p.stddev();
+    prepare();
+}
+
+void Classifier::save_binary(const std::string& filename) const
+{
+    if (!members_.empty()) throw std::runtime_error("Ensembles can not be converted");
+    if (model) throw std::runtime_error("Model is mapped from a binary file already");
+    ModelFile::write(filename, labels_, mean_, stddev_, nn);
 }
 
 const Classifier::Vector&    Classifier::mean()       const { return mean_; }
@@ -66,74 +358,483 @@ std::ostream& operator<<(std::ostream& os, const Classifier& c)
 }
 
 
-Classifier::Teacher::Teacher(Classifier& c, const NeuralNet& network, const LabelList& l, DataSetRef train, DataSetRef test, DataSetRef xval) :
-    cls(c), train(train), test(test), xval(xval)
+Classifier::Teacher::Teacher(Classifier& c, const NeuralNet& network, const LabelList& l, DataSetRef train, DataSetRef test, DataSetRef xval,
+                             bool randomize, bool keep_zeros) :
+    cls(c), train(train), test(test), xval(xval), log(&std::cout), cluster(0), keep_zeros(keep_zeros), threads(1),
+    status_(RUNNING), chunk(0), iter(0), miss(0), rate_(0.0), olderr(0.0), initerr(0.0),
+    xval_sample(0), xval_z(1.96), old_exact(true), n_estimates(0), n_evaluations(0)
 {
     if (train.count() == 0) throw std::runtime_error("No tarining data!");
     c.nn = network;
+    c.model.reset();
+    c.members_.clear();
     c.mean_ = train.mean();
     c.stddev_ = train.stddev();
     c.labels_ = l;
-    c.labels_.resize(train.sample(0).second.size());
-    net = NetTeacherPtr(new NeuralNet::Teacher(c.nn));
+    c.labels_.resize(train.output_size());
+    net = NetTeacherPtr(new NeuralNet::Teacher(c.nn, randomize, keep_zeros));
+    c.prepare();
 }
 
-void Classifier::Teacher::present(size_t n, size_t offset, Real learning_rate)
+void Classifier::Teacher::present(const DataSampleList& data, size_t n, size_t offset, Real learning_rate,
+                                  const std::vector<size_t>* perm)
 {
-    if (n == 0) n = train.count();
-    size_t end = std::min(offset + n, train.count());
-    for (size_t i = offset; i < end; ++i)
-        net->sample(train.sample(i).first, train.sample(i).second);
+    if (n == 0) n = data.size();
+    size_t end = std::min(offset + n, data.size());
+    for (size_t i = offset; i < end; ++i) {
+        const SampleSource::DataSample& s = data[perm ? (*perm)[i] : i];
+        net->sample(s.first, s.second);
+    }
     net->teach(learning_rate);
 }
 
 void Classifier::Teacher::present(size_t n, Real learning_rate)
 {
-    if (n == 0) n = train.count();
-    for (size_t i = 0; i < train.count(); i += n) present(n, i, learning_rate);
+    std::vector<size_t> order(train.blocks());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+    std::random_shuffle(order.begin(), order.end());
+    unsigned seed = std::rand();
+
+    if (cluster) {
+        // the other processes take the block order, the network and the seed of
+        // the shuffles within blocks from rank 0, so that their slices of every block are disjoint
+        std::vector<Real> cmd;
+        cmd.push_back(PRESENT);
+        cmd.push_back(n);
+        cmd.push_back(learning_rate);
+        cmd.push_back(seed);
+        cmd.insert(cmd.end(), order.begin(), order.end());
+        cluster->broadcast(cmd);
+        share_network();
+        net = NetTeacherPtr(new NeuralNet::Teacher(cls.nn, false, keep_zeros));
+    }
+    present(order, n, learning_rate, seed);
+}
+
+void Classifier::Teacher::present(const std::vector<size_t>& order, size_t n, Real learning_rate, unsigned seed)
+{
+    Profile::Scope scope("train pass");
+    size_t part = (cluster ? cluster->rank() : 0), parts = (cluster ? cluster->size() : 1);
+    std::vector<Real> weights;
+    std::vector<size_t> perm;
+    const std::vector<size_t>* mix = (train.shuffle_blocks() ? &perm : 0);
+
+    // next block is loaded in the background while the current one is presented
+    Prefetcher loader(train, order);
+    for (size_t k = 0; const DataSampleList* data = loader.next(); ++k) {
+        if (mix) {
+            // samples of a stream block are shuffled by a generator of the pass seed and the block
+            boost::mt19937 gen(seed + order[k]);
+            boost::random_number_generator<boost::mt19937, long> rnd(gen);
+            perm.resize(data->size());
+            for (size_t i = 0; i < perm.size(); ++i) perm[i] = i;
+            std::random_shuffle(perm.begin(), perm.end(), rnd);
+        }
+        // in a cluster, weights are averaged after every DataSet::BLOCK_SIZE samples (an in-memory set is a single block)
+        size_t rounds = (cluster ? (data->size() + DataSet::BLOCK_SIZE - 1) / DataSet::BLOCK_SIZE : 1);
+        for (size_t r = 0; r < rounds; ++r) {
+            size_t lo = data->size() * r / rounds, hi = data->size() * (r + 1) / rounds;
+            size_t first = lo + (hi - lo) * part / parts, last = lo + (hi - lo) * (part + 1) / parts;
+            size_t step = (n == 0 ? last - first : n);
+            for (size_t i = first; i < last; i += step) present(*data, std::min(step, last - i), i, learning_rate, mix);
+            Profile::count("trained samples", last - first);
+            if (cluster) {
+                cls.nn.get_weights(weights);
+                cluster->average(weights);
+                cls.nn.set_weights(weights);
+            }
+        }
+    }
+
+    cls.prepare();
+
+    const Prefetcher::Stats& s = loader.stats();
+    input_stats_ += s;
+    if (log && train.blocks() > 1)
+        *log << "Input: " << s.batches << " blocks, " << s.stalls << " stalls (" << s.stall_time << " s)"
+                  << ", load " << s.load_time << " s, avg. queue " << s.avg_depth() << std::endl;
 }
 
 bool Classifier::Teacher::teach(size_t n, Real rate)
+{
+    if (cluster && cluster->rank() > 0) return follow();
+    start(n, rate);
+    while (step() == RUNNING) ;
+    if (cluster) {
+        std::vector<Real> cmd;
+        cmd.push_back(STOP);
+        cmd.push_back(status_);
+        cluster->broadcast(cmd);
+    }
+    return status_ == CONVERGED;
+}
+
+void Classifier::Teacher::set_cluster(Cluster* c)
+{
+    cluster = (c && c->size() > 1 ? c : 0);
+    if (cluster && cluster->rank() > 0) log = 0;
+}
+
+void Classifier::Teacher::set_batch(BatchOptimizer::Method m, size_t threads)
+{
+    optimizer = BatchOptimizer::create(m);
+    this->threads = std::max<size_t>(threads, 1);
+}
+
+void Classifier::Teacher::batch_step()
+{
+    std::vector<Real> w;
+    cls.nn.get_weights(w);
+    optimizer->step(w, *this, rate_);
+    cls.nn.set_weights(w);
+    cls.prepare();
+}
+
+Real Classifier::Teacher::evaluate(const std::vector<Real>& w, std::vector<Real>& g)
+{
+    cls.nn.set_weights(w);
+    return gradient(g);
+}
+
+/// training error and its gradient over parts of blocks
+struct GradientPart {
+    const NeuralNet* nn;
+    std::vector<Real> g;
+    Real err;
+
+    explicit GradientPart(const NeuralNet& nn, size_t n) : nn(&nn), g(n, 0.0), err(0.0) {}
+
+    /// add samples [begin, end) of a block
+    void add(const SampleSource::DataSampleList* blk, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i) err += nn->gradient((*blk)[i].first, (*blk)[i].second, g);
+    }
+};
+
+Real Classifier::Teacher::gradient(std::vector<Real>& g)
+{
+    Profile::Scope scope("gradient");
+    if (cluster) {
+        if (cluster->rank() == 0) {
+            std::vector<Real> cmd(1, GRADIENT);
+            cluster->broadcast(cmd);
+        }
+        share_network();
+    }
+    size_t part = (cluster ? cluster->rank() : 0), parts = (cluster ? cluster->size() : 1);
+
+    // every thread sums its slice of the slice of every block of this process
+    cls.nn.get_weights(g);
+    std::vector<GradientPart> partial(threads, GradientPart(cls.nn, g.size()));
+    std::vector<size_t> order(train.blocks());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+    Prefetcher loader(train, order);
+    while (const DataSampleList* data = loader.next()) {
+        size_t first = data->size() * part / parts, n = data->size() * (part + 1) / parts - first;
+        if (threads == 1) partial[0].add(data, first, first + n);
+        else {
+            boost::thread_group group;
+            for (size_t t = 0; t < threads; ++t)
+                group.create_thread(boost::bind(&GradientPart::add, &partial[t], data,
+                                                first + n * t / threads, first + n * (t + 1) / threads));
+            group.join_all();
+        }
+        Profile::count("gradient samples", n);
+    }
+    input_stats_ += loader.stats();
+
+    // the sum of the cluster is sent along with the error
+    g.assign(g.size() + 1, 0.0);
+    for (size_t t = 0; t < threads; ++t) {
+        g[0] += partial[t].err;
+        for (size_t i = 0; i < partial[t].g.size(); ++i) g[i + 1] += partial[t].g[i];
+    }
+    if (cluster) cluster->sum(g);
+    Real err = g[0];
+    g.erase(g.begin());
+    for (size_t i = 0; i < frozen.size() && i < g.size(); ++i) if (frozen[i]) g[i] = 0.0;
+    return err;
+}
+
+void Classifier::Teacher::share_network() const
+{
+    std::vector<Real> weights;
+    if (cluster->rank() == 0) cls.nn.get_weights(weights);
+    cluster->broadcast(weights);
+    if (cluster->rank() > 0) {
+        cls.nn.set_weights(weights);
+        cls.prepare();
+    }
+}
+
+bool Classifier::Teacher::follow()
+{
+    for (;;) {
+        std::vector<Real> cmd;
+        cluster->broadcast(cmd);
+        if (cmd.empty()) throw std::runtime_error("Empty cluster command");
+        switch (static_cast<int>(cmd[0])) {
+            case PRESENT: {
+                if (cmd.size() < 4) throw std::runtime_error("Invalid cluster command");
+                std::vector<size_t> order(cmd.begin() + 4, cmd.end());
+                share_network();
+                net = NetTeacherPtr(new NeuralNet::Teacher(cls.nn, false, keep_zeros));
+                present(order, static_cast<size_t>(cmd[1]), cmd[2], static_cast<unsigned>(cmd[3]));
+                break;
+            }
+            case EVALUATE:
+                xval_error();
+                break;
+            case GRADIENT: {
+                std::vector<Real> g;
+                gradient(g);
+                break;
+            }
+            case STOP:
+                status_ = static_cast<Status>(static_cast<int>(cmd.at(1)));
+                return status_ == CONVERGED;
+            default:
+                throw std::runtime_error("Unknown cluster command");
+        }
+    }
+}
+
+void Classifier::Teacher::start(size_t n, Real rate)
+{
+    chunk = n;
+    rate_ = rate;
+    iter = miss = 0;
+    n_estimates = 0;
+    n_evaluations = 1;
+    olderr = initerr = (xval_sample > 0 && xval_sample < xval.count() ? draw_xval_sample() : xval_error());
+    old_exact = true;
+    status_ = RUNNING;
+
+    // zero weights of a pruned network are not trained (bias weights always are)
+    frozen.clear();
+    if (optimizer.get()) {
+        optimizer->reset();
+        if (keep_zeros) {
+            const NeuralNet::LayerArray& layers = cls.nn.get_layers();
+            for (size_t l = 0; l < layers.size(); ++l) {
+                const NeuralNet::Matrix& w = layers[l].weight_matrix();
+                for (size_t i = 0; i < w.size1(); ++i)
+                    for (size_t o = 0; o < w.size2(); ++o) frozen.push_back(i > 0 && w(i, o) == 0.0);
+            }
+        }
+    }
+}
+
+Classifier::Teacher::Status Classifier::Teacher::step()
 {
     const Real thres = 0.998;
-    int max_iter = 10000, iter = 0;
-    int miss = 0; // miss count
-    Real err = 0.0, olderr = xval_error(), err_ratio;
-    Real initerr = olderr;
-    err = olderr;
-
-    while (miss < 3) {
-        if (iter >= max_iter) return false;
-        if (iter > 3 && err > initerr) return false;
-        iter++;
-
-        NeuralNet bak = cls.nn; // save backup
-
-        std::cout << "Miss: " << miss << ", Error: " << err << ", Rate: " << rate << std::endl;
-
-        present(n, rate);   // training iteration
-        err = xval_error(); // classifier error
-        err_ratio = err / olderr;
-
-        if (err_ratio > thres) ++miss;
-        else miss = 0;
-
-        if (miss) {
-            rate *= 0.5; // adjust learning rate
-            if (err_ratio > 1.0 / thres) {
-                cls.nn = bak;  // restore backup if error increased
-                err = olderr;  // and error info
-                net = NetTeacherPtr(new NeuralNet::Teacher(cls.nn, false)); // re-initialize teacher
+    const size_t max_iter = 10000;
+
+    if (status_ != RUNNING) return status_;
+    if (iter >= max_iter) return status_ = FAILED;
+    if (iter > 3) {
+        int rise = (sample.empty() ? (olderr > initerr ? 1 : -1) : compare(sample_old, sample_init, 1.0));
+        if (rise == 0) {
+            olderr = xval_error();
+            old_exact = true;
+            ++n_evaluations;
+            rise = (olderr > initerr ? 1 : -1);
+        }
+        if (rise > 0) return status_ = FAILED;
+    }
+    iter++;
+
+    NeuralNet bak = cls.nn; // save backup
+
+    if (log) *log << "Miss: " << miss << ", Error: " << olderr << (old_exact ? "" : " (estimate)") << ", Rate: " << rate_ << std::endl;
+
+    // training iteration
+    if (optimizer.get()) batch_step();
+    else present(chunk, rate_);
+
+    // classifier error, new to old error ratio is compared to the miss and restore thresholds
+    Real err;
+    bool exact = true;
+    int over_miss, over_restore;
+    std::vector<Real> sample_new;
+    if (sample.empty()) {
+        err = xval_error();
+        ++n_evaluations;
+        over_miss = (err / olderr > thres ? 1 : -1);
+        over_restore = (err / olderr > 1.0 / thres ? 1 : -1);
+    } else {
+        sample_new = sample_errors();
+        over_miss = compare(sample_new, sample_old, thres);
+        over_restore = compare(sample_new, sample_old, 1.0 / thres);
+        if (over_miss && over_restore) {
+            Real se;
+            estimate(sample_new, err, se);
+            exact = false;
+            ++n_estimates;
+        } else {
+            // ambiguous, both networks are evaluated on the whole set
+            if (!old_exact) {
+                olderr = xval_error(bak);
+                old_exact = true;
+                ++n_evaluations;
+            }
+            err = xval_error();
+            ++n_evaluations;
+            over_miss = (err / olderr > thres ? 1 : -1);
+            over_restore = (err / olderr > 1.0 / thres ? 1 : -1);
+        }
+    }
+
+    if (over_miss > 0) ++miss;
+    else miss = 0;
+
+    if (miss) {
+        rate_ *= 0.5; // adjust learning rate
+        if (over_restore > 0) {
+            cls.nn = bak;  // restore backup if error increased
+            err = olderr;  // and error info
+            exact = old_exact;
+            sample_new = sample_old;
+            net = NetTeacherPtr(new NeuralNet::Teacher(cls.nn, false, keep_zeros)); // re-initialize teacher
+            if (optimizer.get()) optimizer->reset();
+            cls.prepare();
+        }
+    }
+
+    olderr = err;
+    old_exact = exact;
+    sample_old.swap(sample_new);
+    if (miss >= 3) status_ = CONVERGED;
+    return status_;
+}
+
+Real Classifier::Teacher::draw_xval_sample()
+{
+    // one pass over the set: the error is summed and every stratum (desired label)
+    // keeps a uniform random reservoir of up to xval_sample items
+    std::vector<DataSampleList> reservoir;
+    std::vector<std::vector<Real> > reservoir_err;
+    strata_size.clear();
+
+    std::vector<size_t> order(xval.blocks());
+    for (size_t b = 0; b < order.size(); ++b) order[b] = b;
+    Real total = 0.0;
+    Prefetcher loader(xval, order);
+    while (const DataSampleList* blk = loader.next())
+        for (size_t i = 0; i < blk->size(); ++i) {
+            const SampleSource::DataSample& s = (*blk)[i];
+            Real e = cls.error(s.first, s.second);
+            total += e;
+
+            size_t h = std::max_element(s.second.begin(), s.second.end()) - s.second.begin();
+            if (h >= strata_size.size()) {
+                strata_size.resize(h + 1, 0);
+                reservoir.resize(h + 1);
+                reservoir_err.resize(h + 1);
             }
+            size_t seen = strata_size[h]++;
+            if (seen < xval_sample) {
+                reservoir[h].push_back(s);
+                reservoir_err[h].push_back(e);
+            } else {
+                size_t j = std::rand() % (seen + 1);
+                if (j < xval_sample) {
+                    reservoir[h][j] = s;
+                    reservoir_err[h][j] = e;
+                }
+            }
+        }
+
+    // proportional allocation, at least two items per stratum for a variance estimate
+    sample.clear();
+    stratum.clear();
+    sample_init.clear();
+    strata_drawn.assign(strata_size.size(), 0);
+    for (size_t h = 0; h < strata_size.size(); ++h) {
+        size_t n = static_cast<size_t>(Real(xval_sample) * strata_size[h] / xval.count() + 0.5);
+        n = std::min(std::max<size_t>(n, 2), reservoir[h].size());
+        // a prefix of a shuffled reservoir is a uniform sample too
+        std::vector<size_t> pick(reservoir[h].size());
+        for (size_t i = 0; i < pick.size(); ++i) pick[i] = i;
+        std::random_shuffle(pick.begin(), pick.end());
+        for (size_t i = 0; i < n; ++i) {
+            sample.push_back(reservoir[h][pick[i]]);
+            sample_init.push_back(reservoir_err[h][pick[i]]);
+            stratum.push_back(h);
         }
+        strata_drawn[h] = n;
+    }
+    sample_old = sample_init;
+    return total;
+}
 
-        olderr = err;
+std::vector<Real> Classifier::Teacher::sample_errors() const
+{
+    std::vector<Real> err(sample.size());
+    for (size_t i = 0; i < sample.size(); ++i) err[i] = cls.error(sample[i].first, sample[i].second);
+    return err;
+}
+
+void Classifier::Teacher::estimate(const std::vector<Real>& v, Real& total, Real& se) const
+{
+    std::vector<Real> sum(strata_size.size(), 0.0), sumsq(strata_size.size(), 0.0);
+    for (size_t i = 0; i < v.size(); ++i) {
+        sum[stratum[i]] += v[i];
+        sumsq[stratum[i]] += v[i] * v[i];
+    }
+    Real var = 0.0;
+    total = 0.0;
+    for (size_t h = 0; h < strata_size.size(); ++h) {
+        Real n = strata_drawn[h], N = strata_size[h];
+        if (n == 0) continue;
+        Real mean = sum[h] / n;
+        total += N * mean;
+        if (n > 1) {
+            Real s2 = std::max(0.0, (sumsq[h] - n * mean * mean) / (n - 1));
+            var += N * N * (1.0 - n / N) * s2 / n;
+        }
     }
+    se = std::sqrt(var);
+}
 
-    return true;
+int Classifier::Teacher::compare(const std::vector<Real>& a, const std::vector<Real>& b, Real t) const
+{
+    // paired difference of the errors of the same items
+    std::vector<Real> d(a.size());
+    for (size_t i = 0; i < a.size(); ++i) d[i] = a[i] - t * b[i];
+    Real total, se;
+    estimate(d, total, se);
+    if (total > xval_z * se) return 1;
+    if (total < -xval_z * se) return -1;
+    return 0;
+}
+
+Real Classifier::Teacher::xval_error(const NeuralNet& nn)
+{
+    NeuralNet current = cls.nn;
+    cls.nn = nn;
+    cls.prepare();
+    Real err = xval_error();
+    cls.nn = current;
+    cls.prepare();
+    return err;
 }
 
 Real Classifier::Teacher::train_error() const { return cls.error(train); }
 Real Classifier::Teacher::test_error()  const { return cls.error(test); }
-Real Classifier::Teacher::xval_error()  const { return cls.error(xval); }
+Real Classifier::Teacher::xval_error()  const
+{
+    Profile::Scope scope("xval");
+    if (!cluster) return cls.error(xval);
+
+    // every process evaluates its slice of every block
+    if (cluster->rank() == 0) {
+        std::vector<Real> cmd(1, EVALUATE);
+        cluster->broadcast(cmd);
+    }
+    share_network();
+    std::vector<Real> err(1, cls.error(xval, cluster->rank(), cluster->size()));
+    cluster->sum(err);
+    return err[0];
+}
 
@@ -11,6 +11,14 @@
 
 #include "neuralnet.hpp"
 #include "features.hpp"
+#include "prefetch.hpp"
+#include "modelfile.hpp"
+#include "inference.hpp"
+#include "optimizer.hpp"
+#include <boost/shared_ptr.hpp>
+
+class Cluster;
+class Projection;
 
 /**
  * Classifier capable of merging several results together.
@@ -31,20 +39,93 @@ class Classifier {
         Vector exec(const Vector& in) const;
         /// classify dataset
         Vector exec(const DataSet& data) const;
+        /**
+         * classify sliding windows of a record
+         * @param data record frames in time order
+         * @param window window length in frames (the whole record if longer)
+         * @param hop distance between starts of consecutive windows in frames
+         * @return average output of every window
+         */
+        std::vector<Vector> exec(const DataSet& data, size_t window, size_t hop) const;
 
-        /// classification error of an data frame
+        /// classification error of a normalized data frame (single networks, ensembles are evaluated on datasets)
         Real error(const Vector& in, const Vector& out) const;
-        /// classification error of an dataset
-        Real error(const DataSet& data) const;
+        /**
+         * classification error of a normalized dataset
+         * @param part, parts only the @a part -th of @a parts equal slices of every block is evaluated
+         */
+        Real error(const SampleSource& data, size_t part = 0, size_t parts = 1) const;
+        /**
+         * soft targets for distillation, the data are classified in a single pass
+         * @param data normalized data
+         * @param out unnormalized frames of @a data with the outputs of this classifier as desired outputs
+         */
+        void soft_targets(const SampleSource& data, DataSet& out) const;
 
         /// load from input stream
         void load(std::istream& is);
+        /**
+         * load from a text or binary model file, or an ensemble list
+         * @param filename model file name
+         * @param map use the weights of a binary model in place (otherwise they are copied)
+         * @param verify check the checksum of binary models
+         */
+        void load_file(const std::string& filename, bool map = true, bool verify = false);
+        /**
+         * make an ensemble of classifiers evaluated in a single pass
+         * @param files member model files (text or binary)
+         * @param errors error of every member, members are weighted by its inverse (WEIGHTED combination)
+         * @param c how member outputs are combined
+         * @param verify check the checksum of binary models
+         */
+        void load_ensemble(const std::vector<std::string>& files, const std::vector<Real>& errors = std::vector<Real>(),
+                           InferencePlan::Combination c = InferencePlan::MEAN, bool verify = false);
+        /// change how ensemble member outputs are combined
+        void set_combination(InferencePlan::Combination c);
+        /// number of networks evaluated (more than one for an ensemble)
+        size_t members() const { return plan.members(); }
+        /// number of layers evaluated by the sparse kernel
+        size_t sparse_layers() const { return plan.sparse_layers(); }
+
+        /**
+         * zero the least important input weights of every layer of the network
+         * @param fraction fraction of input weights of every layer to be zero afterwards
+         * @param data normalized data to weigh the weights by the magnitudes of their inputs
+         *        (sensitivity), plain weight magnitudes are compared if not given
+         */
+        void prune(Real fraction, const SampleSource* data = 0);
+
+        /**
+         * network of the classifier for inputs normalized by another mean and stddev,
+         * the first layer absorbs the change, so that the outputs stay the same
+         * (to continue training on data normalized by their own statistics)
+         */
+        NeuralNet renormalized(const Vector& mean, const Vector& stddev) const;
+
+        /**
+         * put a projection in front of the network trained on projected data, the projection
+         * and the normalization of its outputs become its first (linear) layer
+         * and the classifier takes the unprojected inputs afterwards
+         */
+        void prepend(const Projection& p);
+
+        /// write binary model file
+        void save_binary(const std::string& filename) const;
+        /// weights are mapped from a binary model file
+        bool mapped() const { return model.get() != 0; }
+
+        /// check whether given file is an ensemble list
+        static bool is_ensemble(const std::string& filename);
+        /// read ensemble list (member files and their errors)
+        static void read_ensemble(const std::string& filename, std::vector<std::string>& files, std::vector<Real>& errors);
+        /// write ensemble list
+        static void write_ensemble(const std::string& filename, const std::vector<std::string>& files, const std::vector<Real>& errors);
 
         /// get mean
         const Vector& mean() const;
         /// get standard deviation
         const Vector& stddev() const;
-        /// get neural network
+        /// get neural network (empty if the model is mapped)
         const NeuralNet& neural_net() const;
         /// get output labels
         const LabelList& labels() const;
@@ -52,10 +133,19 @@ class Classifier {
     public:
         
         /// Classifier learning context
-        class Teacher {
+        class Teacher : private BatchOptimizer::Objective {
             public:
                 typedef std::auto_ptr<NeuralNet::Teacher> NetTeacherPtr;
-                typedef const DataSet& DataSetRef;
+                typedef std::auto_ptr<BatchOptimizer> OptimizerPtr;
+                typedef const SampleSource& DataSetRef;
+                typedef SampleSource::DataSampleList DataSampleList;
+
+                /// state of the New Bob training
+                enum Status {
+                    RUNNING,   ///< error is still falling
+                    CONVERGED, ///< error stopped falling
+                    FAILED     ///< error rose above the initial one or too many iterations
+                };
 
             public:
 
@@ -65,20 +155,28 @@ class Classifier {
                  * @param train training data set
                  * @param test testing data set
                  * @param xval crossvalidation data set
+                 * @param randomize start from random weights instead of those of @a network
+                 * @param keep_zeros zero weights of @a network are not trained (fine-tuning of a pruned network)
                  */
-                explicit Teacher(Classifier& c, const NeuralNet& network, const LabelList& l, DataSetRef train, DataSetRef test, DataSetRef xval);
+                explicit Teacher(Classifier& c, const NeuralNet& network, const LabelList& l, DataSetRef train, DataSetRef test, DataSetRef xval,
+                                 bool randomize = true, bool keep_zeros = false);
 
                 /**
                  * present several samples and propagate through the network
+                 * (the classifier is not prepared for classification afterwards)
+                 * @param data block of training samples
                  * @param n number of samples to present
-                 * @param offset the index of the first sample form trainig set to present
+                 * @param offset the index of the first sample form the block to present
                  * @param learning_rate neural network learning rate
+                 * @param perm order of the block samples (stored order if null)
                  */
-                void present(size_t n, size_t offset, Real learning_rate);
+                void present(const DataSampleList& data, size_t n, size_t offset, Real learning_rate,
+                             const std::vector<size_t>* perm = 0);
 
                 /**
-                 * train classifier with training dataset split into chunks by n samples
-                 * @param n number of samples to present at a time, whole training set if 0
+                 * train classifier with training dataset split into chunks by n samples.
+                 * Training set blocks are visited in random order.
+                 * @param n number of samples to present at a time, whole block if 0
                  * @param learning_rate neural network learning rate
                  */
                 void present(size_t n, Real learning_rate);
@@ -92,6 +190,58 @@ class Classifier {
                  */
                 bool teach(size_t n, Real init_learning_rate);
 
+                /**
+                 * Prepare stepwise New Bob training, teach() is start() followed
+                 * by step() until the training is not running.
+                 * @param n number of samples to present at a time, whole training set if 0
+                 * @param init_learning_rate initial neural network learning rate
+                 */
+                void start(size_t n, Real init_learning_rate);
+                /// do one New Bob iteration (a training pass and crossvalidation) if still running
+                Status step();
+                /// New Bob training state
+                Status status() const { return status_; }
+                /// crossvalidation error of the network kept by the last iteration (may be an estimate)
+                Real error() const { return olderr; }
+                /// current learning rate
+                Real rate() const { return rate_; }
+                /// number of New Bob iterations done
+                size_t iterations() const { return iter; }
+                /// set stream for training progress (none if 0)
+                void set_log(std::ostream* os) { log = os; }
+
+                /**
+                 * Train on all processes of a cluster (data parallel). Every process presents its
+                 * slice of every DataSet::BLOCK_SIZE training samples, after which the weights are averaged;
+                 * crossvalidation is split among the processes as well. Rank 0 runs New Bob
+                 * in teach() and the other ranks follow its commands until it finishes
+                 * (they do not log). All ranks need the same data.
+                 */
+                void set_cluster(Cluster* c);
+
+                /**
+                 * Train by a full-batch optimizer instead of chunked backpropagation (set before start()).
+                 * Every New Bob iteration is one optimizer iteration on the exact gradient of the training
+                 * error, which is summed over slices of every block on @a threads threads (and over the
+                 * processes of a cluster); the learning rate is the maximum change of a weight.
+                 */
+                void set_batch(BatchOptimizer::Method m, size_t threads = 1);
+                /// number of full-batch training passes (gradient evaluations) done
+                size_t batch_passes() const { return optimizer.get() ? optimizer->evaluations() : 0; }
+
+                /**
+                 * Estimate crossvalidation error on a fixed stratified random subsample
+                 * (set before start()). New Bob decisions are taken on the estimates and
+                 * the whole crossvalidation set is evaluated only when a decision is not
+                 * clear at the confidence level of @a z standard errors.
+                 * @param n subsample size (0 evaluates the whole set every time)
+                 * @param z half-width of the confidence interval in standard errors
+                 */
+                void set_xval_sample(size_t n, Real z = 1.96) { xval_sample = n; xval_z = z; }
+                /// number of crossvalidation estimates and full evaluations done by New Bob
+                size_t xval_estimates() const { return n_estimates; }
+                size_t xval_evaluations() const { return n_evaluations; }
+
                 /// calculate error on training data
                 Real train_error() const;
                 /// calculate error on test data
@@ -99,10 +249,64 @@ class Classifier {
                 /// calculate error on crossvalidation data
                 Real xval_error() const;
 
+                /// training data loader statistics accumulated over all passes
+                const Prefetcher::Stats& input_stats() const { return input_stats_; }
+
+            private:
+                /// commands of rank 0 to the other cluster processes
+                enum Command { PRESENT, EVALUATE, GRADIENT, STOP };
+
+                /**
+                 * present blocks in given order, in cluster only the slice of every block of this process
+                 * @param seed seed of the shuffles within blocks (the same in every process)
+                 */
+                void present(const std::vector<size_t>& order, size_t n, Real learning_rate, unsigned seed);
+                /// one full-batch optimizer iteration
+                void batch_step();
+                /// training error at weights @a w and its gradient (the network keeps the weights)
+                Real evaluate(const std::vector<Real>& w, std::vector<Real>& g);
+                /// training error of the network and its gradient, summed over threads and cluster processes
+                Real gradient(std::vector<Real>& g);
+                /// send the network of rank 0 to the other cluster processes
+                void share_network() const;
+                /// carry out commands of rank 0 until it stops, return whether the training converged
+                bool follow();
+                /// draw the crossvalidation subsample, return the error of the whole set
+                Real draw_xval_sample();
+                /// errors of the subsample items
+                std::vector<Real> sample_errors() const;
+                /// stratified estimate of the total of per-item values of the subsample and its standard error
+                void estimate(const std::vector<Real>& v, Real& total, Real& se) const;
+                /// 1 if error @a a exceeds @a t times error @a b, -1 if not, 0 if the estimates can not tell
+                int compare(const std::vector<Real>& a, const std::vector<Real>& b, Real t) const;
+                /// crossvalidation error of another network
+                Real xval_error(const NeuralNet& nn);
+
             private:
                 Classifier& cls;
                 NetTeacherPtr net;
                 DataSetRef train, test, xval;
+                Prefetcher::Stats input_stats_;
+                std::ostream* log;
+                Cluster* cluster;
+                bool keep_zeros;
+                OptimizerPtr optimizer;   ///< full-batch optimizer (0 for backpropagation)
+                size_t threads;           ///< gradient threads
+                std::vector<bool> frozen; ///< weights kept at zero by the optimizer
+                // New Bob state
+                Status status_;
+                size_t chunk, iter, miss;
+                Real rate_, olderr, initerr;
+                // crossvalidation subsample
+                size_t xval_sample;
+                Real xval_z;
+                DataSampleList sample;            ///< subsample items
+                std::vector<size_t> stratum;      ///< stratum (desired label) of every item
+                std::vector<size_t> strata_size;  ///< crossvalidation samples in every stratum
+                std::vector<size_t> strata_drawn; ///< subsample items in every stratum
+                std::vector<Real> sample_old, sample_init; ///< item errors of the kept and the initial network
+                bool old_exact;                   ///< olderr is the error of the whole set
+                size_t n_estimates, n_evaluations;
         };
 
         friend class Teacher;
@@ -111,6 +315,14 @@ class Classifier {
         NeuralNet nn;          ///< neural network
         Vector mean_, stddev_; ///< normalization constants
         LabelList labels_;     ///< output labels
+        boost::shared_ptr<const ModelFile> model; ///< mapped binary model (nn is empty if set)
+        InferencePlan plan;    ///< network prepared for classification
+        std::vector<boost::shared_ptr<const Classifier> > members_; ///< ensemble members
+        std::vector<Real> member_errors;          ///< ensemble member errors
+        InferencePlan::Combination combination;   ///< ensemble output combination
+
+        /// rebuild the inference plan after the network changed
+        void prepare();
 };
 
 // IO
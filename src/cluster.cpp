@@ -0,0 +1,201 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "cluster.hpp"
+#include "timer.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+
+const double CONNECT_TIMEOUT = 30.0; // s, how long ranks wait for each other to start
+const int CONNECT_RETRY = 50;        // ms between connection attempts
+
+/// socket address of a path
+static sockaddr_un socket_address(const std::string& path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+Cluster::Cluster(const std::string& socket_path, size_t rank, size_t size) :
+    path(socket_path), rank_(rank), size_(size)
+{
+    if (size == 0 || rank >= size) throw std::runtime_error("Invalid cluster rank");
+    if (size == 1) return;
+    sockaddr_un addr = socket_address(path);
+    double deadline = wall_time() + CONNECT_TIMEOUT;
+
+    if (rank > 0) {
+        // rank 0 may not be listening yet
+        int fd = -1;
+        while (fd < 0) {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) throw std::runtime_error("Unable to create socket");
+            if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) break;
+            close(fd);
+            fd = -1;
+            if (wall_time() > deadline) throw std::runtime_error("Unable to connect to " + path);
+            usleep(CONNECT_RETRY * 1000);
+        }
+        peers.push_back(fd);
+        send(fd, std::vector<Real>(1, Real(rank)));
+        return;
+    }
+
+    // replace a stale socket, but never a regular file
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) throw std::runtime_error("Not a socket: " + path);
+        unlink(path.c_str());
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw std::runtime_error("Unable to create socket");
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, size) < 0) {
+        std::string err = std::strerror(errno);
+        close(listen_fd);
+        throw std::runtime_error("Unable to listen on " + path + ": " + err);
+    }
+
+    // peers introduce themselves by their rank
+    peers.assign(size - 1, -1);
+    try {
+        for (size_t n = 1; n < size; ++n) {
+            pollfd pfd;
+            pfd.fd = listen_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int timeout = static_cast<int>(1000.0 * (deadline - wall_time()));
+            if (timeout <= 0 || poll(&pfd, 1, timeout) <= 0) throw std::runtime_error("Cluster processes did not connect");
+            int fd = accept(listen_fd, 0, 0);
+            if (fd < 0) throw std::runtime_error("Unable to accept a cluster connection");
+            std::vector<Real> hello;
+            try {
+                receive(fd, hello);
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            size_t r = static_cast<size_t>(hello.at(0));
+            if (r == 0 || r >= size || peers[r - 1] >= 0) {
+                close(fd);
+                throw std::runtime_error("Invalid rank of a cluster process");
+            }
+            peers[r - 1] = fd;
+        }
+    } catch (...) {
+        close(listen_fd);
+        for (size_t i = 0; i < peers.size(); ++i) if (peers[i] >= 0) close(peers[i]);
+        unlink(path.c_str());
+        throw;
+    }
+    close(listen_fd);
+}
+
+Cluster::~Cluster()
+{
+    for (size_t i = 0; i < peers.size(); ++i) if (peers[i] >= 0) close(peers[i]);
+    if (rank_ == 0 && size_ > 1) unlink(path.c_str());
+    for (size_t i = 0; i < children.size(); ++i) waitpid(children[i], 0, 0);
+}
+
+std::auto_ptr<Cluster> Cluster::spawn(size_t size)
+{
+    size = std::max<size_t>(size, 1);
+    boost::filesystem::path tmp = boost::filesystem::temp_directory_path()
+                                / boost::filesystem::unique_path("genre-%%%%-%%%%-%%%%.sock");
+
+    // buffered output would be written by every process
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> pids;
+    for (size_t r = 1; r < size; ++r) {
+        pid_t pid = fork();
+        if (pid < 0) throw std::runtime_error("Unable to start a cluster process");
+        if (pid == 0) return std::auto_ptr<Cluster>(new Cluster(tmp.string(), r, size));
+        pids.push_back(pid);
+    }
+    std::auto_ptr<Cluster> c(new Cluster(tmp.string(), 0, size));
+    c->children = pids;
+    return c;
+}
+
+void Cluster::send(int fd, const std::vector<Real>& v)
+{
+    boost::uint64_t n = v.size();
+    const char* parts[2] = { reinterpret_cast<const char*>(&n), v.empty() ? 0 : reinterpret_cast<const char*>(&v[0]) };
+    size_t sizes[2] = { sizeof(n), v.size() * sizeof(Real) };
+    for (size_t p = 0; p < 2; ++p)
+        for (size_t done = 0; done < sizes[p]; ) {
+            ssize_t r = ::send(fd, parts[p] + done, sizes[p] - done, MSG_NOSIGNAL);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) throw std::runtime_error("Cluster connection lost");
+            done += r;
+        }
+}
+
+void Cluster::receive(int fd, std::vector<Real>& v)
+{
+    boost::uint64_t n = 0;
+    for (int p = 0; p < 2; ++p) {
+        char* data = (p == 0 ? reinterpret_cast<char*>(&n) : reinterpret_cast<char*>(&v[0]));
+        size_t size = (p == 0 ? sizeof(n) : v.size() * sizeof(Real));
+        for (size_t done = 0; done < size; ) {
+            ssize_t r = recv(fd, data + done, size - done, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) throw std::runtime_error("Cluster connection lost");
+            done += r;
+        }
+        if (p == 0) {
+            v.resize(n);
+            if (n == 0) break;
+        }
+    }
+}
+
+void Cluster::broadcast(std::vector<Real>& v)
+{
+    if (rank_ > 0) receive(peers[0], v);
+    else for (size_t i = 0; i < peers.size(); ++i) send(peers[i], v);
+}
+
+void Cluster::sum(std::vector<Real>& v)
+{
+    if (rank_ > 0) {
+        send(peers[0], v);
+        return;
+    }
+    std::vector<Real> part;
+    for (size_t i = 0; i < peers.size(); ++i) {
+        receive(peers[i], part);
+        if (part.size() != v.size())
+            throw std::runtime_error("Cluster process " + boost::lexical_cast<std::string>(i + 1) + " sent a different number of values");
+        for (size_t j = 0; j < v.size(); ++j) v[j] += part[j];
+    }
+}
+
+void Cluster::average(std::vector<Real>& v)
+{
+    sum(v);
+    if (rank_ == 0)
+        for (size_t j = 0; j < v.size(); ++j) v[j] /= size_;
+    broadcast(v);
+}
@@ -0,0 +1,69 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef CLUSTER_HPP_
+#define CLUSTER_HPP_
+
+#include "common.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <sys/types.h>
+
+/**
+ * Group of cooperating processes on one machine.
+ * Rank 0 listens on a Unix domain socket and the other ranks connect to it,
+ * collective operations are relayed through rank 0. All ranks have to call
+ * the same collective operations in the same order.
+ */
+class Cluster : boost::noncopyable {
+    public:
+        /**
+         * join a cluster (rank 0 waits until all the others are connected)
+         * @param socket_path socket file name
+         * @param rank rank of the calling process (0 to size - 1)
+         * @param size number of processes
+         */
+        explicit Cluster(const std::string& socket_path, size_t rank, size_t size);
+        /// destructor, rank 0 removes the socket and waits for the processes it started
+        ~Cluster();
+
+        /**
+         * fork the calling process into @a size processes joined in a cluster
+         * (no threads may be running), the original process gets rank 0
+         */
+        static std::auto_ptr<Cluster> spawn(size_t size);
+
+        /// rank of this process
+        size_t rank() const { return rank_; }
+        /// number of processes
+        size_t size() const { return size_; }
+
+        /// copy values of rank 0 to all ranks
+        void broadcast(std::vector<Real>& v);
+        /// replace values of all ranks by their mean (all ranks have the same number of them)
+        void average(std::vector<Real>& v);
+        /// sum values of all ranks into those of rank 0 (the others are kept)
+        void sum(std::vector<Real>& v);
+
+    private:
+        /// send values to a peer
+        void send(int fd, const std::vector<Real>& v);
+        /// receive values from a peer
+        void receive(int fd, std::vector<Real>& v);
+
+    private:
+        std::string path;
+        size_t rank_, size_;
+        std::vector<int> peers;       ///< connections to ranks 1.. (rank 0) or to rank 0
+        std::vector<pid_t> children;  ///< processes started by spawn()
+};
+
+#endif // CLUSTER_HPP_
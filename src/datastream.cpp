@@ -0,0 +1,497 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "datastream.hpp"
+#include "profile.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+using boost::numeric::ublas::zero_vector;
+
+const char STREAM_MAGIC[8] = { 'S', 'F', 'C', 'D', 'A', 'T', 'A', '\n' };
+const boost::uint32_t STREAM_VERSION = 3;
+
+/// binary file header (followed by table info since version 3, mean and m2 vectors; version 1 stored sum and sumsq)
+struct StreamHeader {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t in_size;
+    boost::uint32_t out_size;
+    boost::uint32_t block_size;
+    boost::uint64_t count;
+    boost::uint32_t normalized;
+    boost::uint32_t encoding; ///< zero (REAL) before version 3
+};
+
+/// output table position
+struct StreamTable {
+    boost::uint64_t offset;
+    boost::uint64_t count;
+};
+
+const size_t DataStream::DEFAULT_BLOCK_SIZE;
+
+/// 2^112, rebias between half and single precision exponents
+static const float HALF_REBIAS = std::ldexp(1.0f, 112);
+static const float HALF_UNBIAS = std::ldexp(1.0f, -112);
+/// int16 code of the value 1.0
+static const Real INT16_UNIT = 32767.0;
+
+/// convert float from [-1, 1] to half precision (subnormals included, rounding half up)
+static inline boost::uint16_t float_to_half(float f)
+{
+    boost::uint32_t bits, x;
+    std::memcpy(&bits, &f, sizeof(bits));
+    float a = std::fabs(f) * HALF_UNBIAS;
+    std::memcpy(&x, &a, sizeof(x));
+    return ((bits >> 16) & 0x8000) | ((x + 0x1000) >> 13);
+}
+
+/// convert half precision to float (finite values only)
+static inline float half_to_float(boost::uint16_t h)
+{
+    boost::uint32_t x = static_cast<boost::uint32_t>(h & 0x7fff) << 13;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    f *= HALF_REBIAS;
+    std::memcpy(&x, &f, sizeof(x));
+    x |= static_cast<boost::uint32_t>(h & 0x8000) << 16;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/// size of an encoded input value
+static size_t value_bytes(DataStream::Encoding e)
+{
+    return (e == DataStream::REAL ? sizeof(Real) : sizeof(boost::uint16_t));
+}
+
+bool DataStream::is_stream(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    char magic[sizeof(STREAM_MAGIC)];
+    return ifs.read(magic, sizeof(magic)) && std::memcmp(magic, STREAM_MAGIC, sizeof(magic)) == 0;
+}
+
+DataStream::Encoding DataStream::parse_encoding(const std::string& name)
+{
+    if (name == "real")  return REAL;
+    if (name == "half")  return HALF;
+    if (name == "int16") return INT16;
+    throw std::runtime_error("Unknown data encoding: " + name);
+}
+
+DataStream::DataStream(const std::string& fname) :
+    ifs(fname.c_str(), std::ios::binary), filename(fname), table_offset(0)
+{
+    if (!ifs) throw std::runtime_error("Unable to open data stream " + filename);
+
+    StreamHeader h;
+    if (!ifs.read(reinterpret_cast<char*>(&h), sizeof(h)) || std::memcmp(h.magic, STREAM_MAGIC, sizeof(h.magic)) != 0)
+        throw std::runtime_error("Not a data stream file: " + filename);
+    if (h.version < 1 || h.version > STREAM_VERSION || h.encoding > INT16)
+        throw std::runtime_error("Unsupported data stream version: " + filename);
+
+    if (h.block_size == 0 || h.in_size == 0 || h.out_size == 0)
+        throw std::runtime_error("Invalid data stream header: " + filename);
+
+    version = h.version;
+    enc = static_cast<Encoding>(h.encoding);
+    n_samples = h.count;
+    in_size = h.in_size;
+    out_size = h.out_size;
+    block_size = h.block_size;
+    normalized = h.normalized;
+
+    StreamTable t = { 0, 0 };
+    if (version >= 3) ifs.read(reinterpret_cast<char*>(&t), sizeof(t));
+    check_size(t.offset, t.count);
+
+    FeatureVector v1(in_size), v2(in_size);
+    ifs.read(reinterpret_cast<char*>(&v1[0]), in_size * sizeof(Real));
+    ifs.read(reinterpret_cast<char*>(&v2[0]), in_size * sizeof(Real));
+    if (!ifs) throw std::runtime_error("Truncated data stream header: " + filename);
+    stats = (version == 1 ? RunningStats::from_sums(n_samples, v1, v2) : RunningStats::from_moments(n_samples, v1, v2));
+    data_offset = ifs.tellg();
+
+    if (version >= 3) {
+        table_offset = t.offset;
+        out_table.resize(t.count * out_size);
+        ifs.seekg(table_offset);
+        if (!out_table.empty() && !ifs.read(reinterpret_cast<char*>(&out_table[0]), out_table.size() * sizeof(Real)))
+            throw std::runtime_error("Truncated data stream output table: " + filename);
+    }
+}
+
+void DataStream::check_size(boost::uint64_t table_pos, boost::uint64_t table_count)
+{
+    // all sizes are checked against the file length before they are multiplied, so that nothing overflows
+    std::streamoff pos = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    boost::uint64_t file_size = ifs.tellg(), offset = pos;
+    ifs.seekg(pos);
+    if (!ifs || offset > file_size || in_size > (file_size - offset) / (2 * sizeof(Real)))
+        throw std::runtime_error("Truncated data stream header: " + filename);
+    offset += 2 * in_size * sizeof(Real);
+
+    boost::uint64_t sample_bytes = (version < 3 ? (in_size + out_size) * sizeof(Real)
+                                                : in_size * value_bytes(enc) + sizeof(boost::uint32_t));
+    if (n_samples > (file_size - offset) / sample_bytes)
+        throw std::runtime_error("Data stream is shorter than its sample count: " + filename);
+    boost::uint64_t end = offset + n_samples * sample_bytes;
+    if (version >= 3 && enc != REAL) end += blocks() * 2 * in_size * sizeof(Real);
+    if (end > file_size) throw std::runtime_error("Data stream is shorter than its sample count: " + filename);
+
+    if (version >= 3) {
+        if (table_pos < end || table_pos > file_size || table_count > (file_size - table_pos) / (out_size * sizeof(Real)))
+            throw std::runtime_error("Invalid data stream output table: " + filename);
+    }
+}
+
+size_t DataStream::count() const { return n_samples; }
+size_t DataStream::blocks() const { return (n_samples + block_size - 1) / block_size; }
+size_t DataStream::input_size() const { return in_size; }
+size_t DataStream::output_size() const { return out_size; }
+
+FeatureVector DataStream::mean() const { return stats.mean(); }
+FeatureVector DataStream::stddev() const { return stats.variance(); }
+
+size_t DataStream::block_bytes() const
+{
+    if (version < 3) return block_size * (in_size + out_size) * sizeof(Real);
+    size_t params = (enc == REAL ? 0 : 2 * in_size * sizeof(Real));
+    return params + block_size * (in_size * value_bytes(enc) + sizeof(boost::uint32_t));
+}
+
+size_t DataStream::read_block(size_t idx, std::vector<Real>& params, std::vector<char>& codes, std::vector<boost::uint32_t>& out) const
+{
+    if (idx >= blocks()) throw std::out_of_range("Data stream block index out of range");
+
+    const size_t n = std::min(block_size, n_samples - idx * block_size);
+    params.resize(enc == REAL ? 0 : 2 * in_size);
+    codes.resize(n * in_size * value_bytes(enc));
+    out.resize(n);
+
+    boost::mutex::scoped_lock lock(io_mutex);
+    ifs.clear();
+    ifs.seekg(data_offset + static_cast<std::streamoff>(idx * block_bytes()));
+    if (!params.empty()) ifs.read(reinterpret_cast<char*>(&params[0]), params.size() * sizeof(Real));
+    ifs.read(&codes[0], codes.size());
+    ifs.read(reinterpret_cast<char*>(&out[0]), n * sizeof(boost::uint32_t));
+    if (!ifs) throw std::runtime_error("Truncated data stream: " + filename);
+    return n;
+}
+
+size_t DataStream::decode_block(size_t idx, std::vector<Real>& in, std::vector<boost::uint32_t>& out, bool normalize) const
+{
+    Profile::Scope scope("stream block");
+    std::vector<Real> params;
+    std::vector<char> codes;
+    const size_t n = read_block(idx, params, codes, out);
+
+    // decoding and normalization are folded into a single affine map per dimension: x = a + b * code
+    std::vector<Real> a(in_size, 0.0), b(in_size, 1.0);
+    if (enc != REAL)
+        for (size_t j = 0; j < in_size; ++j) {
+            a[j] = params[j];
+            b[j] = params[in_size + j] / (enc == INT16 ? INT16_UNIT : 1.0);
+        }
+    if (normalize) {
+        FeatureVector m = mean(), s = stddev();
+        for (size_t j = 0; j < in_size; ++j) {
+            a[j] = (a[j] - m(j)) / s(j);
+            b[j] = b[j] / s(j);
+        }
+    }
+
+    // contiguous branch-free loops, left to the compiler to vectorize
+    in.resize(n * in_size);
+    Real* x = &in[0];
+    const Real* pa = &a[0];
+    const Real* pb = &b[0];
+    if (enc == REAL) {
+        const Real* q = reinterpret_cast<const Real*>(&codes[0]);
+        for (size_t i = 0; i < n; ++i, x += in_size, q += in_size)
+            for (size_t j = 0; j < in_size; ++j) x[j] = pa[j] + pb[j] * q[j];
+    } else if (enc == INT16) {
+        const boost::int16_t* q = reinterpret_cast<const boost::int16_t*>(&codes[0]);
+        for (size_t i = 0; i < n; ++i, x += in_size, q += in_size)
+            for (size_t j = 0; j < in_size; ++j) x[j] = pa[j] + pb[j] * q[j];
+    } else {
+        const boost::uint16_t* q = reinterpret_cast<const boost::uint16_t*>(&codes[0]);
+        for (size_t i = 0; i < n; ++i, x += in_size, q += in_size)
+            for (size_t j = 0; j < in_size; ++j) x[j] = pa[j] + pb[j] * half_to_float(q[j]);
+    }
+    return n;
+}
+
+const DataStream::DataSampleList& DataStream::block(size_t idx, DataSampleList& buf) const
+{
+    if (idx >= blocks()) throw std::out_of_range("Data stream block index out of range");
+
+    if (version < 3) {
+        // raw inputs and outputs of every sample
+        const size_t stride = in_size + out_size;
+        const size_t first = idx * block_size;
+        const size_t n = std::min(block_size, n_samples - first);
+
+        std::vector<Real> raw(n * stride);
+        {
+            boost::mutex::scoped_lock lock(io_mutex);
+            ifs.clear();
+            ifs.seekg(data_offset + static_cast<std::streamoff>(first * stride * sizeof(Real)));
+            if (!ifs.read(reinterpret_cast<char*>(&raw[0]), raw.size() * sizeof(Real)))
+                throw std::runtime_error("Truncated data stream: " + filename);
+        }
+
+        FeatureVector m, s;
+        if (!normalized) { m = mean(); s = stddev(); }
+
+        buf.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const Real* p = &raw[i * stride];
+            buf[i].first.resize(in_size, false);
+            buf[i].second.resize(out_size, false);
+            std::copy(p, p + in_size, buf[i].first.begin());
+            std::copy(p + in_size, p + stride, buf[i].second.begin());
+            if (!normalized)
+                for (size_t j = 0; j < in_size; ++j) buf[i].first(j) = (buf[i].first(j) - m(j)) / s(j);
+        }
+    } else {
+        std::vector<Real> in;
+        std::vector<boost::uint32_t> out;
+        size_t n = decode_block(idx, in, out, !normalized);
+
+        buf.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (out[i] * out_size + out_size > out_table.size())
+                throw std::runtime_error("Corrupted data stream output index: " + filename);
+            buf[i].first.resize(in_size, false);
+            buf[i].second.resize(out_size, false);
+            std::copy(&in[i * in_size], &in[i * in_size] + in_size, buf[i].first.begin());
+            std::copy(&out_table[out[i] * out_size], &out_table[out[i] * out_size] + out_size, buf[i].second.begin());
+        }
+    }
+    return buf;
+}
+
+
+/// copy the first @a bytes of a file
+static void copy_prefix(const std::string& from, const std::string& to, std::streamoff bytes)
+{
+    std::ifstream is(from.c_str(), std::ios::binary);
+    std::ofstream os(to.c_str(), std::ios::binary | std::ios::trunc);
+    std::vector<char> buf(1 << 20);
+    while (bytes > 0) {
+        std::streamsize n = std::min<std::streamoff>(bytes, buf.size());
+        if (!is.read(&buf[0], n) || !os.write(&buf[0], n)) throw std::runtime_error("Unable to copy data stream " + from);
+        bytes -= n;
+    }
+}
+
+DataStream::Writer::Writer(const std::string& filename, bool append, Encoding e, size_t bsize, size_t mix_blocks) :
+    filename(filename), tmp_name(filename + ".tmp"), header(false), enc(e), block_size(bsize), mix_size(bsize * mix_blocks),
+    n_samples(0), in_size(0), out_size(0), table_offset(0), kept(0)
+{
+    if (!append && block_size == 0) throw std::runtime_error("Data stream block size must be positive");
+
+    // the stream is written to a temporary file, which replaces the original one when the writer is closed
+    if (append) {
+        DataStream in(filename);
+        if (in.version < 3) throw std::runtime_error("Data stream " + filename + " uses an old format, rebuild it to append");
+        if (in.normalized) throw std::runtime_error("Cannot append to a normalized data stream " + filename);
+        enc = in.enc;
+        block_size = in.block_size;
+        mix_size = block_size * mix_blocks;
+        n_samples = in.n_samples;
+        in_size = in.in_size;
+        out_size = in.out_size;
+        stats = in.stats;
+        out_table = in.out_table;
+        for (size_t i = 0; i < out_table.size() / out_size; ++i)
+            out_index[std::vector<Real>(&out_table[i * out_size], &out_table[i * out_size] + out_size)] = i;
+        header = true;
+
+        // a partial last block is completed by the new samples, its stored codes are
+        // kept as they are if the new samples fit in its range (see flush_block())
+        size_t full = n_samples / block_size;
+        if (full * block_size < n_samples) {
+            in.decode_block(full, block, block_out, false);
+            std::vector<boost::uint32_t> out;
+            kept = in.read_block(full, kept_params, kept_codes, out);
+        }
+        std::streamoff end = in.data_offset + static_cast<std::streamoff>(full * in.block_bytes());
+        copy_prefix(filename, tmp_name, end);
+        ofs.open(tmp_name.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        ofs.seekp(end);
+    } else {
+        ofs.open(tmp_name.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    }
+    if (!ofs) throw std::runtime_error("Unable to create data stream " + filename);
+}
+
+DataStream::Writer::~Writer()
+{
+    // a stream that was not closed is incomplete, the original file is left intact
+    if (ofs.is_open()) {
+        ofs.close();
+        std::remove(tmp_name.c_str());
+    }
+}
+
+void DataStream::Writer::write_header()
+{
+    StreamHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, STREAM_MAGIC, sizeof(h.magic));
+    h.version = STREAM_VERSION;
+    h.in_size = in_size;
+    h.out_size = out_size;
+    h.block_size = block_size;
+    h.count = n_samples;
+    h.normalized = 0;
+    h.encoding = enc;
+    StreamTable t = { static_cast<boost::uint64_t>(table_offset), out_index.size() };
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    ofs.write(reinterpret_cast<const char*>(&t), sizeof(t));
+    FeatureVector m = stats.mean(), m2 = stats.m2();
+    if (m.size() != in_size) m = m2 = zero_vector<Real>(in_size);
+    ofs.write(reinterpret_cast<const char*>(&m[0]), in_size * sizeof(Real));
+    ofs.write(reinterpret_cast<const char*>(&m2[0]), in_size * sizeof(Real));
+    header = true;
+}
+
+void DataStream::Writer::write_sample(const FeatureVector& in, boost::uint32_t out)
+{
+    block.insert(block.end(), in.begin(), in.end());
+    block_out.push_back(out);
+    ++n_samples;
+    if (block_out.size() == block_size) flush_block();
+}
+
+void DataStream::Writer::flush_block()
+{
+    const size_t n = block_out.size();
+    if (n == 0) return;
+
+    if (enc == REAL) {
+        ofs.write(reinterpret_cast<const char*>(&block[0]), block.size() * sizeof(Real));
+    } else {
+        // samples of a block completed by appending keep their codes if the new ones fit in its range,
+        // otherwise the block is encoded again (its stored samples are quantized once more)
+        bool fits = (kept > 0);
+        for (size_t i = kept; fits && i < n; ++i)
+            for (size_t j = 0; j < in_size; ++j)
+                if (std::fabs(block[i * in_size + j] - kept_params[j]) > kept_params[in_size + j]) fits = false;
+
+        // every dimension is mapped to [-1, 1] by the block's offset and scale
+        std::vector<Real> params(2 * in_size);
+        if (fits) params = kept_params;
+        else for (size_t j = 0; j < in_size; ++j) {
+            Real lo = block[j], hi = block[j];
+            for (size_t i = 1; i < n; ++i) {
+                lo = std::min(lo, block[i * in_size + j]);
+                hi = std::max(hi, block[i * in_size + j]);
+            }
+            params[j] = (lo + hi) / 2;
+            params[in_size + j] = (hi > lo ? (hi - lo) / 2 : 1.0);
+        }
+
+        std::vector<boost::uint16_t> codes(block.size());
+        size_t first = 0;
+        if (fits) {
+            std::memcpy(&codes[0], &kept_codes[0], kept_codes.size());
+            first = kept;
+        }
+        for (size_t i = first; i < n; ++i)
+            for (size_t j = 0; j < in_size; ++j) {
+                Real v = (block[i * in_size + j] - params[j]) / params[in_size + j];
+                v = std::max<Real>(-1.0, std::min<Real>(1.0, v));
+                if (enc == INT16) codes[i * in_size + j] = static_cast<boost::int16_t>(std::floor(v * INT16_UNIT + 0.5));
+                else              codes[i * in_size + j] = float_to_half(static_cast<float>(v));
+            }
+
+        ofs.write(reinterpret_cast<const char*>(&params[0]), params.size() * sizeof(Real));
+        ofs.write(reinterpret_cast<const char*>(&codes[0]), codes.size() * sizeof(boost::uint16_t));
+    }
+    ofs.write(reinterpret_cast<const char*>(&block_out[0]), n * sizeof(boost::uint32_t));
+    if (!ofs) throw std::runtime_error("Error writing data stream.");
+
+    block.clear();
+    block_out.clear();
+    kept = 0;
+    kept_params.clear();
+    kept_codes.clear();
+}
+
+void DataStream::Writer::add_sample(const FeatureVector& in, const FeatureVector& out)
+{
+    push(in, out);
+    stats.add(in);
+}
+
+void DataStream::Writer::add(const DataSet& data)
+{
+    for (size_t i = 0; i < data.count(); ++i) push(data.sample(i).first, data.sample(i).second);
+    stats.merge(data.stats());
+}
+
+void DataStream::Writer::push(const FeatureVector& in, const FeatureVector& out)
+{
+    if (!ofs.is_open()) throw std::logic_error("Adding data to a closed data stream.");
+
+    if (!header) {
+        in_size = in.size();
+        out_size = out.size();
+        write_header(); // placeholder, rewritten on close
+    }
+    if (in.size() != in_size || out.size() != out_size)
+        throw std::runtime_error("Data sample size mismatch.");
+
+    // outputs are stored once in the output table and referenced by index
+    std::vector<Real> key(out.begin(), out.end());
+    OutputIndex::iterator it = out_index.find(key);
+    if (it == out_index.end()) {
+        it = out_index.insert(std::make_pair(key, static_cast<boost::uint32_t>(out_index.size()))).first;
+        out_table.insert(out_table.end(), key.begin(), key.end());
+    }
+
+    if (mix_size == 0) {
+        write_sample(in, it->second);
+    } else if (mix.size() < mix_size) {
+        mix.push_back(std::make_pair(in, it->second));
+    } else {
+        // emit a random sample from the shuffle buffer and put the new one in its place
+        size_t r = std::rand() % mix.size();
+        write_sample(mix[r].first, mix[r].second);
+        mix[r] = std::make_pair(in, it->second);
+    }
+}
+
+void DataStream::Writer::close()
+{
+    if (!ofs.is_open()) return;
+    if (!header) throw std::runtime_error("Nothing to output.");
+    std::random_shuffle(mix.begin(), mix.end());
+    for (size_t i = 0; i < mix.size(); ++i) write_sample(mix[i].first, mix[i].second);
+    mix.clear();
+    flush_block();
+
+    table_offset = ofs.tellp();
+    if (!out_table.empty())
+        ofs.write(reinterpret_cast<const char*>(&out_table[0]), out_table.size() * sizeof(Real));
+    write_header();
+    ofs.close();
+    if (ofs.fail() || std::rename(tmp_name.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Unable to write data stream " + filename);
+}
@@ -0,0 +1,148 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef DATASTREAM_HPP_
+#define DATASTREAM_HPP_
+
+#include "features.hpp"
+#include <fstream>
+#include <string>
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Data set stored on disk in a binary block format, read block by block.
+ * Only the block currently requested is held in memory, so the data set
+ * may be much larger than available RAM.
+ *
+ * File layout (host byte order):
+ *   header: magic, version, input size, output size, block size,
+ *           sample count, normalization flag, input encoding,
+ *           output table position, mean and m2 vectors
+ *   blocks: per-dimension offset and scale (compact encodings only),
+ *           encoded inputs of all samples, output table index of each sample
+ *   output table: distinct output vectors as raw Real values
+ *
+ * Streams of version 1 and 2 (raw inputs and outputs of every sample) are still read.
+ */
+class DataStream : public SampleSource {
+    public:
+        /// default number of samples in a block
+        static const size_t DEFAULT_BLOCK_SIZE = 4096;
+
+        /// input vector encoding
+        enum Encoding {
+            REAL  = 0, ///< raw Real values
+            HALF  = 1, ///< 16-bit floats scaled per block and dimension
+            INT16 = 2  ///< 16-bit integers scaled per block and dimension
+        };
+
+    public:
+        /// open a data stream file
+        explicit DataStream(const std::string& filename);
+
+        size_t count() const;
+        size_t blocks() const;
+        /// load block into @a buf (normalized, in stored order) and return it, safe to call concurrently
+        const DataSampleList& block(size_t idx, DataSampleList& buf) const;
+        size_t input_size() const;
+        size_t output_size() const;
+        FeatureVector mean() const;
+        FeatureVector stddev() const;
+        bool shuffle_blocks() const { return true; }
+
+        /// input encoding
+        Encoding encoding() const { return enc; }
+
+        /// check whether given file is a data stream file
+        static bool is_stream(const std::string& filename);
+        /// parse encoding name (real, half, int16)
+        static Encoding parse_encoding(const std::string& name);
+
+    public:
+        /**
+         * Data stream writer.
+         * Samples are mixed through a bounded shuffle buffer before being
+         * written, so that consecutive frames of a record are spread over
+         * several blocks. Statistics are accumulated on the fly and stored
+         * in the header when the writer is closed.
+         */
+        class Writer {
+            public:
+                /**
+                 * create a data stream file
+                 * @param filename output file name
+                 * @param append add samples to an existing stream (its encoding and block size are kept)
+                 * @param enc input encoding
+                 * @param block_size number of samples in a block
+                 * @param mix_blocks size of the shuffle buffer in blocks (0 disables mixing)
+                 */
+                explicit Writer(const std::string& filename, bool append = false, Encoding enc = REAL,
+                                size_t block_size = DEFAULT_BLOCK_SIZE, size_t mix_blocks = 16);
+                /// destructor, discards the output unless the writer was closed
+                ~Writer();
+                /// add a data sample
+                void add_sample(const FeatureVector& in, const FeatureVector& out);
+                /// add all (unnormalized) samples of a data set, merging its statistics
+                void add(const DataSet& data);
+                /// flush the shuffle buffer, finalize the header and replace the file by the output
+                void close();
+                /// number of samples written so far
+                size_t count() const { return n_samples; }
+            private:
+                typedef std::map<std::vector<Real>, boost::uint32_t> OutputIndex;
+                typedef std::vector<std::pair<FeatureVector, boost::uint32_t> > PendingList;
+                void write_header();
+                void write_sample(const FeatureVector& in, boost::uint32_t out);
+                void flush_block();
+                void push(const FeatureVector& in, const FeatureVector& out);
+            private:
+                std::fstream ofs;
+                std::string filename, tmp_name; ///< output file and the file written until it is closed
+                bool header;                ///< header has been written
+                Encoding enc;
+                size_t block_size, mix_size, n_samples;
+                size_t in_size, out_size;
+                std::streamoff table_offset; ///< output table position (end of blocks)
+                RunningStats stats;
+                PendingList mix;            ///< shuffle buffer (inputs and output indices)
+                std::vector<Real> block;    ///< inputs of the block being filled
+                std::vector<boost::uint32_t> block_out; ///< output indices of the block being filled
+                size_t kept;                 ///< samples of the block stored before appending
+                std::vector<Real> kept_params; ///< their stored block parameters
+                std::vector<char> kept_codes;  ///< and input codes
+                OutputIndex out_index;      ///< output table index
+                std::vector<Real> out_table; ///< output table
+        };
+
+    private:
+        /// read and decode block inputs (normalized if requested) and output indices
+        size_t decode_block(size_t idx, std::vector<Real>& in, std::vector<boost::uint32_t>& out, bool normalize) const;
+        /// read raw block parameters, input codes and output indices, return the number of samples
+        size_t read_block(size_t idx, std::vector<Real>& params, std::vector<char>& codes, std::vector<boost::uint32_t>& out) const;
+        /// size of a full block in bytes
+        size_t block_bytes() const;
+        /// check the header sizes against the file length
+        void check_size(boost::uint64_t table_pos, boost::uint64_t table_count);
+
+    private:
+        mutable std::ifstream ifs;
+        mutable boost::mutex io_mutex; ///< serializes reads, blocks may be loaded from several threads
+        std::string filename;
+        unsigned version;
+        Encoding enc;
+        size_t n_samples, in_size, out_size, block_size;
+        std::streamoff data_offset, table_offset;
+        RunningStats stats;
+        bool normalized;
+        std::vector<Real> out_table; ///< distinct output vectors
+};
+
+#endif // DATASTREAM_HPP_
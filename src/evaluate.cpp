@@ -0,0 +1,120 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "evaluate.hpp"
+#include <iomanip>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
+/// quote a string for JSON
+static std::string json_str(const std::string& s)
+{
+    std::string r("\"");
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' || s[i] == '\\') r += '\\';
+        if (static_cast<unsigned char>(s[i]) < 0x20) r += ' ';
+        else r += s[i];
+    }
+    return r + "\"";
+}
+
+Evaluation::Evaluation(const LabelList& l, size_t top_k) :
+    labels(l), k(std::max<size_t>(top_k, 1)), n_records(0), n_failed(0), n_untagged(0), n_frames(0),
+    hits1(0), hitsk(0), err_sum(0.0), confusion_(l.size(), std::vector<size_t>(l.size(), 0)) {}
+
+void Evaluation::result(const std::string& file, size_t frames, const Classifier::Vector& scores)
+{
+    boost::filesystem::path tag(file);
+    tag.replace_extension(".tag");
+    if (!boost::filesystem::exists(tag)) { ++n_untagged; return; }
+    AnnotationType a = DataSet::load_annotations(tag.string());
+
+    // annotated genre
+    size_t truth = labels.size();
+    Real best = 0.0;
+    for (size_t l = 0; l < labels.size(); ++l) {
+        AnnotationType::const_iterator it = a.find(labels[l]);
+        if (it != a.end() && it->second > best) { best = it->second; truth = l; }
+    }
+    if (truth == labels.size() || scores.size() != labels.size()) { ++n_untagged; return; }
+
+    // rank of the annotated genre among classifier outputs
+    size_t rank = 0;
+    for (size_t l = 0; l < labels.size(); ++l)
+        if (scores(l) > scores(truth) || (scores(l) == scores(truth) && l < truth)) ++rank;
+    size_t guess = std::max_element(scores.begin(), scores.end()) - scores.begin();
+
+    Classifier::Vector err = DataSet::desired_output(a, labels) - scores;
+    err_sum += inner_prod(err, err);
+    ++n_records;
+    n_frames += frames;
+    if (rank == 0) ++hits1;
+    if (rank < k) ++hitsk;
+    ++confusion_[truth][guess];
+}
+
+void Evaluation::failed(const std::string& file, const std::string& error)
+{
+    ++n_failed;
+    errors.push_back(file + ": " + error);
+}
+
+Real Evaluation::top1() const { return n_records ? Real(hits1) / n_records : 0.0; }
+Real Evaluation::topk() const { return n_records ? Real(hitsk) / n_records : 0.0; }
+Real Evaluation::mean_error() const { return n_records ? err_sum / n_records : 0.0; }
+
+void Evaluation::write_text(std::ostream& os, const ClassifyPipeline::Stats& s) const
+{
+    for (size_t i = 0; i < errors.size(); ++i) os << "!!! " << errors[i] << std::endl;
+    os << "=== Evaluated " << n_records << " records, " << n_frames << " frames ("
+       << n_failed << " failed, " << n_untagged << " without genre annotation)" << std::endl;
+    os << "top-1 accuracy: " << std::setprecision(4) << 100.0 * top1() << "% (" << hits1 << "/" << n_records << ")" << std::endl;
+    os << "top-" << k << " accuracy: " << 100.0 * topk() << "% (" << hitsk << "/" << n_records << ")" << std::endl;
+    os << "mean error:     " << std::setprecision(6) << mean_error() << std::endl;
+
+    os << "--- Confusion matrix (rows: annotated, columns: classified)" << std::endl;
+    os << std::setw(12) << "";
+    for (size_t c = 0; c < labels.size(); ++c) os << std::setw(12) << labels[c];
+    os << std::setw(10) << "recall" << std::endl;
+    for (size_t r = 0; r < labels.size(); ++r) {
+        size_t total = 0;
+        os << std::setw(12) << labels[r];
+        for (size_t c = 0; c < labels.size(); ++c) {
+            os << std::setw(12) << confusion_[r][c];
+            total += confusion_[r][c];
+        }
+        if (total) os << std::setw(9) << std::setprecision(3) << 100.0 * confusion_[r][r] / total << '%';
+        os << std::endl;
+    }
+
+    os << "--- Time: " << std::setprecision(4) << s.wall_time << " s (" << s.files / std::max(s.wall_time, 1e-9) << " files/s)"
+       << ", busy: read " << s.read_time << " s, extract " << s.extract_time << " s, infer " << s.infer_time << " s" << std::endl;
+    if (s.silent)
+        os << "--- Silent frames skipped: " << s.silent << " (" << std::setprecision(3)
+           << 100.0 * s.silent / (s.frames + s.silent) << "%)" << std::endl;
+}
+
+void Evaluation::write_json(std::ostream& os, const ClassifyPipeline::Stats& s) const
+{
+    os << "{\n  \"records\": " << n_records << ", \"frames\": " << n_frames << ", \"silent\": " << s.silent
+       << ", \"failed\": " << n_failed << ", \"untagged\": " << n_untagged << ",\n";
+    os << "  \"top1\": " << top1() << ", \"topk\": " << topk() << ", \"k\": " << k
+       << ", \"mean_error\": " << mean_error() << ",\n";
+    os << "  \"labels\": [";
+    for (size_t l = 0; l < labels.size(); ++l) os << (l ? ", " : "") << json_str(labels[l]);
+    os << "],\n  \"confusion\": [";
+    for (size_t r = 0; r < labels.size(); ++r) {
+        os << (r ? ",\n                " : "") << "[";
+        for (size_t c = 0; c < labels.size(); ++c) os << (c ? ", " : "") << confusion_[r][c];
+        os << "]";
+    }
+    os << "],\n  \"errors\": [";
+    for (size_t i = 0; i < errors.size(); ++i) os << (i ? ", " : "") << json_str(errors[i]);
+    os << "],\n  \"time\": {\"wall\": " << s.wall_time << ", \"read\": " << s.read_time
+       << ", \"extract\": " << s.extract_time << ", \"infer\": " << s.infer_time << "}\n}" << std::endl;
+}
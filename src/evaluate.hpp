@@ -0,0 +1,64 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef EVALUATE_HPP_
+#define EVALUATE_HPP_
+
+#include "pipeline.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Classification accuracy on annotated records.
+ * The annotated genre of a record is its best scoring label in the .tag file
+ * next to the .wav file, records without any of the labels are skipped.
+ */
+class Evaluation : public ClassifyPipeline::Sink {
+    public:
+        typedef std::vector<std::vector<size_t> > Matrix;
+
+    public:
+        /**
+         * constructor
+         * @param labels classifier output labels
+         * @param top_k a record counts as top-k hit if its genre is among the k best scoring labels
+         */
+        explicit Evaluation(const LabelList& labels, size_t top_k = 2);
+
+        void result(const std::string& file, size_t frames, const Classifier::Vector& scores);
+        void failed(const std::string& file, const std::string& error);
+
+        /// number of evaluated records
+        size_t records() const { return n_records; }
+        /// top-1 accuracy
+        Real top1() const;
+        /// top-k accuracy
+        Real topk() const;
+        /// mean squared error with respect to the desired output
+        Real mean_error() const;
+        /// confusion matrix (rows: annotated genre, columns: classified genre)
+        const Matrix& confusion() const { return confusion_; }
+
+        /// write text report
+        void write_text(std::ostream& os, const ClassifyPipeline::Stats& s) const;
+        /// write JSON report
+        void write_json(std::ostream& os, const ClassifyPipeline::Stats& s) const;
+
+    private:
+        LabelList labels;
+        size_t k;
+        size_t n_records, n_failed, n_untagged, n_frames;
+        size_t hits1, hitsk;
+        Real err_sum;
+        Matrix confusion_;
+        std::vector<std::string> errors; ///< failed records
+};
+
+#endif // EVALUATE_HPP_
@@ -7,27 +7,84 @@
 
 
 #include "features.hpp"
+#include "profile.hpp"
 #include <stdexcept>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <WaveFile.h>
 #include <feature/MfccExtractor.h>
 #include <boost/numeric/ublas/vector_proxy.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 const unsigned FRAME_LENGTH = 30;
 const unsigned PARAMS_PER_FRAME = 15;
 const double FRAME_OVERLAP = 0.66;
 const double PREEMPHASIS_FACTOR = 0.9375;
+const double GATE_REFERENCE = 0.95; // quantile of frame levels the gate is relative to
+const double NOISE_ZCR = 0.35;      // zero-crossing rate of noise-like frames
 
 Features::Features(const std::string& filename) :
     fea(new Aquila::MfccExtractor(FRAME_LENGTH, PARAMS_PER_FRAME))
 {
-    Aquila::WaveFile wav(FRAME_LENGTH, FRAME_OVERLAP);
-    wav.load(filename);
+    extract(*read_wave(filename));
+}
+
+Features::Features(const Aquila::WaveFile& wav) :
+    fea(new Aquila::MfccExtractor(FRAME_LENGTH, PARAMS_PER_FRAME))
+{
+    extract(wav);
+}
+
+std::auto_ptr<Aquila::WaveFile> Features::read_wave(const std::string& filename)
+{
+    Profile::Scope scope("wav load");
+    std::auto_ptr<Aquila::WaveFile> wav(new Aquila::WaveFile(FRAME_LENGTH, FRAME_OVERLAP));
+    wav->load(filename);
+    return wav;
+}
+
+Real Features::frame_period() { return FRAME_LENGTH * (1.0 - FRAME_OVERLAP) / 1000.0; }
+
+/// append a little-endian integer to a buffer
+static void put_le(std::string& s, unsigned long v, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) s += static_cast<char>((v >> (8 * i)) & 0xff);
+}
+
+void Features::write_wave(const std::string& filename, unsigned rate, const std::vector<short>& samples)
+{
+    std::string h("RIFF");
+    put_le(h, 36 + 2 * samples.size(), 4);
+    h += "WAVEfmt ";
+    put_le(h, 16, 4);       // format chunk size
+    put_le(h, 1, 2);        // PCM
+    put_le(h, 1, 2);        // mono
+    put_le(h, rate, 4);
+    put_le(h, 2 * rate, 4); // byte rate
+    put_le(h, 2, 2);        // block align
+    put_le(h, 16, 2);       // bits per sample
+    h += "data";
+    put_le(h, 2 * samples.size(), 4);
+    for (size_t i = 0; i < samples.size(); ++i) put_le(h, static_cast<unsigned short>(samples[i]), 2);
+
+    std::ofstream ofs(filename.c_str(), std::ios::binary);
+    if (!ofs.write(h.data(), h.size())) throw std::runtime_error("Unable to write " + filename);
+}
+
+void Features::extract(const Aquila::WaveFile& wav)
+{
     if (wav.getFramesCount() < 2)
         throw std::runtime_error("record is not long enough");
+    Profile::Scope scope("mfcc");
+    Profile::count("frames", wav.getFramesCount());
     Aquila::TransformOptions options;
     options.preemphasisFactor = PREEMPHASIS_FACTOR;
     options.windowType = Aquila::WIN_HAMMING;
@@ -89,7 +146,6 @@ AnnotationType DataSet::load_annotations(const std::string& filename)
 
 
 
-using boost::numeric::ublas::scalar_vector;
 
 
 size_t DataSet::count() const
@@ -97,22 +153,151 @@ size_t DataSet::count() const
     return samples.size();
 }
 
+const size_t DataSet::BLOCK_SIZE;
+
+size_t DataSet::blocks() const
+{
+    if (norm_mean.size() == 0) return samples.empty() ? 0 : 1;
+    return (samples.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+const DataSet::DataSampleList& DataSet::block(size_t idx, DataSampleList& buf) const
+{
+    assert(idx < blocks());
+    if (norm_mean.size() == 0) return samples;
+
+    Profile::Scope scope("normalize");
+    size_t first = idx * BLOCK_SIZE;
+    size_t n = std::min(BLOCK_SIZE, samples.size() - first);
+    buf.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const DataSample& s = samples[first + i];
+        FeatureVector& v = buf[i].first;
+        v.resize(s.first.size(), false);
+        for (size_t j = 0; j < v.size(); ++j) v(j) = (s.first(j) - norm_mean(j)) / norm_scale(j);
+        buf[i].second = s.second;
+    }
+    return buf;
+}
+
+size_t DataSet::input_size() const
+{
+    return samples.empty() ? 0 : samples[0].first.size();
+}
+
+size_t DataSet::output_size() const
+{
+    return samples.empty() ? 0 : samples[0].second.size();
+}
+
 FeatureVector DataSet::mean() const
 {
-    return element_div(sum, scalar_vector<Real>(sum.size(), count()));
+    return stats_.mean();
 }
 
 FeatureVector DataSet::stddev() const
 {
-    FeatureVector m = mean();
-    FeatureVector v = sumsq;
-    for (size_t i = 0; i < v.size(); ++i) v(i) = v(i) / count() - m(i) * m(i);
-    return v;
+    return stats_.variance();
 }
 
-DataSet::DataSet() : /*labels(l),*/ normalized(false) {}
+FrameSelection::FrameSelection() : stride(1), min_distance(0.0), budget(0), gate(0.0) {}
 
-void DataSet::load(const std::string& filename_base_in, const LabelList& labels)
+std::string FrameSelection::str() const
+{
+    std::ostringstream os;
+    os << "stride " << stride;
+    if (min_distance > 0.0) os << ", distance " << min_distance;
+    if (budget > 0) os << ", budget " << budget;
+    if (gate > 0.0) os << ", gate " << gate << " dB";
+    return os.str();
+}
+
+std::vector<bool> FrameSelection::audible(const Aquila::WaveFile& wav) const
+{
+    size_t n = wav.getFramesCount();
+    std::vector<bool> pass(n, true);
+    if (gate <= 0.0 || n == 0) return pass;
+
+    Profile::Scope scope("gate");
+    const short* x = wav.toArray();
+    size_t length = wav.getSamplesPerFrame(), count = wav.getSamplesCount();
+    size_t hop = std::max<size_t>(length - static_cast<size_t>(length * FRAME_OVERLAP), 1);
+
+    // level (dB) and zero-crossing rate of every frame, computed on the raw samples
+    std::vector<Real> level(n), zcr(n);
+    for (size_t f = 0; f < n; ++f) {
+        size_t begin = std::min(f * hop, count), end = std::min(begin + length, count);
+        Real energy = 0.0;
+        size_t crossings = 0;
+        for (size_t i = begin; i < end; ++i) {
+            energy += Real(x[i]) * x[i];
+            if (i > begin && (x[i] < 0) != (x[i - 1] < 0)) ++crossings;
+        }
+        level[f] = 10.0 * std::log10(energy / std::max<size_t>(end - begin, 1) + 1.0);
+        zcr[f] = Real(crossings) / std::max<size_t>(end - begin, 2);
+    }
+
+    std::vector<Real> sorted(level);
+    std::vector<Real>::iterator ref = sorted.begin() + static_cast<size_t>(GATE_REFERENCE * (n - 1));
+    std::nth_element(sorted.begin(), ref, sorted.end());
+    for (size_t f = 0; f < n; ++f)
+        pass[f] = level[f] >= *ref - gate && (zcr[f] < NOISE_ZCR || level[f] >= *ref - gate / 2);
+    return pass;
+}
+
+std::vector<size_t> FrameSelection::select(const std::vector<FeatureVector>& frames, const std::vector<bool>& audible) const
+{
+    std::vector<size_t> keep, candidates;
+    for (size_t i = 0; i < frames.size(); ++i)
+        if (audible.empty() || audible[i]) candidates.push_back(i);
+    for (size_t i = 0; i < candidates.size(); i += std::max<size_t>(stride, 1)) keep.push_back(candidates[i]);
+
+    if (min_distance > 0.0 && keep.size() > 1) {
+        // distances are measured in units of the record's standard deviation
+        RunningStats st;
+        for (size_t i = 0; i < keep.size(); ++i) st.add(frames[keep[i]]);
+        FeatureVector var = st.variance();
+        Real thres = min_distance * min_distance * var.size();
+
+        std::vector<size_t> pruned(1, keep[0]);
+        for (size_t i = 1; i < keep.size(); ++i) {
+            const FeatureVector& a = frames[keep[i]];
+            const FeatureVector& b = frames[pruned.back()];
+            Real d = 0.0;
+            for (size_t j = 0; j < a.size(); ++j)
+                if (var(j) > 0.0) d += (a(j) - b(j)) * (a(j) - b(j)) / var(j);
+            if (d >= thres) pruned.push_back(keep[i]);
+        }
+        keep.swap(pruned);
+    }
+
+    if (budget > 0 && keep.size() > budget) {
+        std::random_shuffle(keep.begin(), keep.end());
+        keep.resize(budget);
+        std::sort(keep.begin(), keep.end());
+    }
+
+    return keep;
+}
+
+DataSet::DataSet() : /*labels(l),*/ dropped_(0), silent_(0), normalized(false) {}
+
+FeatureVector DataSet::desired_output(const AnnotationType& a, const LabelList& labels)
+{
+    FeatureVector out(labels.size());
+    // clamp every desired input and take logarithm
+    Real m = 1.0;
+    for (size_t i = 0; i < labels.size(); ++i) {
+        AnnotationType::const_iterator it = a.find(labels[i]);
+        out[i] = (it != a.end() ? it->second : 0.0);
+        m = std::max(out[i], m);
+    }
+    for (size_t i = 0; i < labels.size(); ++i)
+        out[i] = std::log(std::max(0.002, std::min(0.998, out[i] / m)));
+    return out;
+}
+
+void DataSet::load(const std::string& filename_base_in, const LabelList& labels, const FrameSelection& sel)
 {
     FeatureVector out;
 
@@ -126,26 +311,73 @@ void DataSet::load(const std::string& filename_base_in, const LabelList& labels)
     if (!boost::filesystem::exists(boost::filesystem::path(filename_base + ".wav")))
         throw std::runtime_error("Wave file '" + filename_base + ".wav' does not exist.");
 
-    if (labels.size() != 0) {
-        AnnotationType a = load_annotations(filename_base + ".tag");
-        out.resize(labels.size());
-        // clamp every desired input and take logarithm
-        Real m = 1.0;
-        for (size_t i = 0; i < labels.size(); ++i) {
-            out[i] = a[labels[i]];
-            m = std::max(out[i], m);
-        }
-        for (size_t i = 0; i < labels.size(); ++i)
-            out[i] = std::log(std::max(0.002, std::min(0.998, out[i] / m)));
-    }
+    if (labels.size() != 0)
+        out = desired_output(load_annotations(filename_base + ".tag"), labels);
+
+    add_record(*Features::read_wave(filename_base + ".wav"), out, sel);
+}
 
+void DataSet::add_record(const Aquila::WaveFile& wav, const FeatureVector& out, const FrameSelection& sel)
+{
     // load MFCC coefficients and associate them with desired output
-    Features f(filename_base + ".wav");
-    for (size_t i = 0; i < f.frames(); ++i)
-        add_sample(f.feature(i), out);
+    Features f(wav);
+    if (!sel.active()) {
+        Profile::Scope scope("deltas");
+        for (size_t i = 0; i < f.frames(); ++i)
+            add_sample(f.feature(i), out);
+        return;
+    }
+
+    // features of gated frames are not computed
+    std::vector<bool> audible = sel.audible(wav);
+    audible.resize(f.frames(), true);
+    std::vector<FeatureVector> frames(f.frames());
+    size_t silent = 0;
+    {
+        Profile::Scope scope("deltas");
+        for (size_t i = 0; i < frames.size(); ++i)
+            if (audible[i]) frames[i] = f.feature(i);
+            else ++silent;
+    }
+    Profile::count("silent frames", silent);
+    std::vector<size_t> keep = sel.select(frames, audible);
+    for (size_t i = 0; i < keep.size(); ++i)
+        add_sample(frames[keep[i]], out);
+    dropped_ += frames.size() - keep.size();
+    silent_ += silent;
 }
 
-void DataSet::load_dir(const std::string& dirname, const LabelList& labels)
+/// shared state of directory loading threads
+struct DirLoader {
+    std::vector<std::string> files;
+    const LabelList* labels;
+    const FrameSelection* sel;
+    size_t next;
+    std::string error;
+    boost::mutex mutex;
+
+    /// thread body: load files into a private dataset
+    void run(DataSet* data)
+    {
+        for (;;) {
+            std::string file;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                if (next >= files.size() || !error.empty()) return;
+                file = files[next++];
+                std::cout << "--- " << file << ".wav" << std::endl;
+            }
+            try {
+                data->load(file, *labels, *sel);
+            } catch (std::exception& e) {
+                boost::mutex::scoped_lock lock(mutex);
+                if (error.empty()) error = e.what();
+            }
+        }
+    }
+};
+
+void DataSet::load_dir(const std::string& dirname, const LabelList& labels, size_t threads, const FrameSelection& sel)
 {
     using boost::filesystem::directory_iterator;
     using boost::filesystem::path;
@@ -153,23 +385,38 @@ void DataSet::load_dir(const std::string& dirname, const LabelList& labels)
     path dirpath(dirname);
     if (!exists(dirpath)) throw std::runtime_error("Directory '" + dirname + "' does not exist.");
     directory_iterator dirend;
-    
+
+    DirLoader loader;
+    loader.labels = &labels;
+    loader.sel = &sel;
+    loader.next = 0;
     for (directory_iterator dir(dirpath); dir != dirend; ++dir)
-        if (dir->path().extension() == ".wav") {
-            std::cout << "--- " << dir->path().string() << std::endl;
-            load((dir->path().parent_path() / dir->path().stem()).string(), labels);
-        }
+        if (dir->path().extension() == ".wav")
+            loader.files.push_back((dir->path().parent_path() / dir->path().stem()).string());
+
+    if (threads <= 1) {
+        loader.run(this);
+    } else {
+        // every thread fills its own dataset, partial results are merged afterwards
+        std::vector<DataSet> parts(threads);
+        boost::thread_group group;
+        for (size_t i = 0; i < threads; ++i)
+            group.create_thread(boost::bind(&DirLoader::run, &loader, &parts[i]));
+        group.join_all();
+        for (size_t i = 0; i < threads; ++i) append(parts[i]);
+    }
+    if (!loader.error.empty()) throw std::runtime_error(loader.error);
 }
 
 void DataSet::load_tmp(const std::string& filename)
 {
     std::ifstream ifs(filename.c_str());
-    FeatureVector in, out;
+    FeatureVector in, out, sum, sumsq;
     ifs >> sum >> sumsq >> normalized;
-    while (ifs) {
-        ifs >> in >> out;
+    while (ifs >> in >> out)
         samples.push_back(std::make_pair(in, out));
-    }
+    // the file stores plain sums, statistics describe the original (unnormalized) data
+    stats_ = RunningStats::from_sums(samples.size(), sum, sumsq);
 }
 
 void DataSet::write_tmp(const std::string& filename) const
@@ -177,14 +424,22 @@ void DataSet::write_tmp(const std::string& filename) const
     if (samples.size() == 0) throw std::runtime_error("Nothing to output.");
 
     std::ofstream ofs(filename.c_str());
-    ofs << sum << ' ' << sumsq << ' ' << normalized << std::endl;
-    for (size_t i = 0; i < samples.size(); ++i)
-        ofs << samples[i].first << ' ' << samples[i].second << std::endl;
+    ofs << stats_.sum() << ' ' << stats_.sumsq() << ' ' << normalized << std::endl;
+    DataSampleList buf;
+    for (size_t b = 0; b < blocks(); ++b) {
+        const DataSampleList& blk = block(b, buf);
+        for (size_t i = 0; i < blk.size(); ++i)
+            ofs << blk[i].first << ' ' << blk[i].second << std::endl;
+    }
 }
 
-void DataSet::shuffle() { std::random_shuffle(samples.begin(), samples.end()); }
+void DataSet::shuffle()
+{
+    Profile::Scope scope("shuffle");
+    std::random_shuffle(samples.begin(), samples.end());
+}
 
-void DataSet::clear() { samples.clear(); normalized = false; sum = sumsq = FeatureVector(); }
+void DataSet::clear() { samples.clear(); normalized = false; stats_.clear(); dropped_ = silent_ = 0; norm_mean = norm_scale = FeatureVector(); }
 
 void DataSet::normalize(FeatureVector& vec) const { vec = element_div(vec - mean(), stddev()); }
 
@@ -192,14 +447,42 @@ void DataSet::add_sample(const FeatureVector& in, const FeatureVector& out)
 {
     if (normalized) throw std::logic_error("Adding data to a normalized dataset.");
 
-    if (sum.size() == 0)
-        sum = sumsq = boost::numeric::ublas::zero_vector<Real>(in.size());
-
-    sum   += in;
-    sumsq += element_prod(in, in); // in^2
+    stats_.add(in);
     samples.push_back(std::make_pair(in, out));
 }
 
+void DataSet::append(const DataSet& data)
+{
+    if (normalized || data.normalized) throw std::logic_error("Appending normalized datasets.");
+
+    stats_.merge(data.stats_);
+    dropped_ += data.dropped_;
+    silent_ += data.silent_;
+    samples.insert(samples.end(), data.samples.begin(), data.samples.end());
+}
+
+void DataSet::add_samples(const SampleSource& data, size_t n)
+{
+    FeatureVector m = data.mean(), s = data.stddev();
+    if (n == 0 || n >= data.count()) n = data.count();
+
+    // one pass with a uniform random reservoir
+    DataSampleList reservoir, buf;
+    size_t seen = 0;
+    for (size_t b = 0; b < data.blocks(); ++b) {
+        const DataSampleList& blk = data.block(b, buf);
+        for (size_t i = 0; i < blk.size(); ++i, ++seen) {
+            if (seen < n) reservoir.push_back(blk[i]);
+            else {
+                size_t j = std::rand() % (seen + 1);
+                if (j < n) reservoir[j] = blk[i];
+            }
+        }
+    }
+    for (size_t i = 0; i < reservoir.size(); ++i)
+        add_sample(element_prod(reservoir[i].first, s) + m, reservoir[i].second);
+}
+
 void DataSet::normalize_all(FeatureVector m, FeatureVector s)
 {
     if (normalized || samples.size() <= 1) return;
@@ -209,9 +492,9 @@ void DataSet::normalize_all(FeatureVector m, FeatureVector s)
         s = stddev();
     }
 
-    for (size_t i = 0; i < samples.size(); ++i)
-        samples[i].first = element_div(samples[i].first - m, s);
-
+    // applied lazily in block()
+    norm_mean = m;
+    norm_scale = s;
     normalized = true;
 }
 
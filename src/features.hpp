@@ -11,12 +11,14 @@
 #define FEATURES_HPP_
 
 #include "common.hpp"
+#include "stats.hpp"
 #include <memory>
 #include <map>
 
 namespace Aquila {
     /// forward declaration
     class MfccExtractor;
+    class WaveFile;
 }
 
 /// type for data annotations
@@ -29,6 +31,14 @@ class Features {
     public:
         /// extract features from a .wav file
         explicit Features(const std::string& filename);
+        /// extract features from a loaded record
+        explicit Features(const Aquila::WaveFile& wav);
+        /// read a .wav file split into frames suitable for feature extraction
+        static std::auto_ptr<Aquila::WaveFile> read_wave(const std::string& filename);
+        /// time between starts of consecutive frames in seconds
+        static Real frame_period();
+        /// write 16-bit mono samples as a .wav file
+        static void write_wave(const std::string& filename, unsigned rate, const std::vector<short>& samples);
         /// destroy features object
         ~Features();
         /// number of post-processed frames
@@ -40,20 +50,93 @@ class Features {
         size_t raw_frames() const;
         /// get raw feature vector for given frame
         FeatureVector raw_feature(size_t frame) const;
+    private:
+        void extract(const Aquila::WaveFile& wav);
     private:
         std::auto_ptr<Aquila::MfccExtractor> fea;
 };
 
 /**
- * Training, testing, or crossvalidation data set.
+ * Selection of frames of a record to be used as data samples.
+ * Consecutive frames overlap and are highly correlated, keeping
+ * only some of them shrinks datasets with little loss of information.
+ * Silence, fades and quiet intros say little about the genre, they may be
+ * gated out on the raw samples before their features are computed.
+ */
+struct FrameSelection {
+    size_t stride;     ///< keep every stride-th frame
+    Real min_distance; ///< drop frames closer than this to the last kept one (in record stddevs, 0 = off)
+    size_t budget;     ///< maximum number of frames per record, randomly subsampled (0 = unlimited)
+    Real gate;         ///< drop frames this many dB quieter than the loud frames of the record (0 = off)
+
+    /// select all frames
+    FrameSelection();
+    /// whether any frames may be dropped
+    bool active() const { return stride > 1 || min_distance > 0.0 || budget > 0 || gate > 0.0; }
+    /// describe selection
+    std::string str() const;
+    /**
+     * Frames of a record passing the energy gate (all if the gate is off).
+     * The threshold adapts to the record: it is relative to the level of its loud frames;
+     * quiet noise-like frames (high zero-crossing rate) are dropped at half the gate.
+     */
+    std::vector<bool> audible(const Aquila::WaveFile& wav) const;
+    /**
+     * select frames of a record, return kept frame indices in ascending order
+     * @param frames features of the frames (only those passing the gate need to be set)
+     * @param audible frames passing the gate (all frames if empty)
+     */
+    std::vector<size_t> select(const std::vector<FeatureVector>& frames, const std::vector<bool>& audible = std::vector<bool>()) const;
+};
+
+/**
+ * Block-wise access to a collection of data samples.
+ * Samples are visited one block at a time, so that the whole collection
+ * does not need to be held in memory at once.
  */
-class DataSet {
+class SampleSource {
     public:
         /// single data sample type (.first = features, .second = output)
         typedef std::pair<FeatureVector, FeatureVector> DataSample;
         /// type of vector of training samples
         typedef std::vector<DataSample> DataSampleList;
 
+    public:
+        /// destructor
+        virtual ~SampleSource() {}
+        /// data samples count
+        virtual size_t count() const = 0;
+        /// number of sample blocks
+        virtual size_t blocks() const = 0;
+        /**
+         * Get a block of samples.
+         * @param idx block index
+         * @param buf storage the block may be loaded into
+         * @return reference to the block samples (either @a buf or internal storage)
+         */
+        virtual const DataSampleList& block(size_t idx, DataSampleList& buf) const = 0;
+        /// input vector size
+        virtual size_t input_size() const = 0;
+        /// output vector size
+        virtual size_t output_size() const = 0;
+        /// data mean
+        virtual FeatureVector mean() const = 0;
+        /// data standard deviation
+        virtual FeatureVector stddev() const = 0;
+        /// samples of a block are stored in write order and need to be shuffled for training
+        virtual bool shuffle_blocks() const { return false; }
+};
+
+/**
+ * Training, testing, or crossvalidation data set.
+ * In-memory data set consists of a single block unless it is being
+ * normalized lazily, in which case it is read in normalized blocks.
+ */
+class DataSet : public SampleSource {
+    public:
+        /// number of samples in a lazily normalized block
+        static const size_t BLOCK_SIZE = 4096;
+
     public:
 
         /// constructor
@@ -63,12 +146,19 @@ class DataSet {
          * Load training data from a file.
          * This function expects <filename_base>.wav to be an audio file
          * and <filename_base>.tag to be a file with annotations (if parse_annotations is true).
-         * Data are added to the dataset.
+         * Data (frames chosen by @a sel) are added to the dataset.
          */
-        void load(const std::string& filename_base, const LabelList& labels = LabelList());
+        void load(const std::string& filename_base, const LabelList& labels = LabelList(), const FrameSelection& sel = FrameSelection());
 
-        /// Load data from all files in given directory (non-recursively).
-        void load_dir(const std::string& dirname, const LabelList& labels);
+        /// extract features of a loaded record and add frames chosen by @a sel with desired output @a out
+        void add_record(const Aquila::WaveFile& wav, const FeatureVector& out, const FrameSelection& sel = FrameSelection());
+
+        /**
+         * Load data from all files in given directory (non-recursively).
+         * With more threads, files are processed concurrently and partial
+         * statistics are merged, the order of samples is not preserved then.
+         */
+        void load_dir(const std::string& dirname, const LabelList& labels, size_t threads = 1, const FrameSelection& sel = FrameSelection());
 
         /// Load data from temporary format
         void load_tmp(const std::string& filename);
@@ -79,6 +169,16 @@ class DataSet {
         /// add a data sample
         void add_sample(const FeatureVector& in, const FeatureVector& out);
 
+        /// add all samples of another dataset, merging statistics
+        void append(const DataSet& data);
+
+        /**
+         * add samples of a normalized source, undoing its normalization
+         * @param data samples normalized by their own statistics
+         * @param n number of samples drawn uniformly at random (all if 0 or more than there are)
+         */
+        void add_samples(const SampleSource& data, size_t n = 0);
+
         /// Clear dataset.
         void clear();
 
@@ -88,20 +188,39 @@ class DataSet {
         /// In-place normalize an input vector
         void normalize(FeatureVector& vec) const;
 
-        /// Normalize the dataset using mean and stddev
+        /**
+         * Normalize the dataset using mean and stddev.
+         * Samples are kept intact, the normalization is applied when blocks are read.
+         */
         void normalize_all(FeatureVector m = FeatureVector(), FeatureVector s = FeatureVector());
         
-        /// get data sample
+        /// get data sample (as stored, without lazy normalization)
         const DataSample& sample(size_t i) const { return samples[i]; }
         /// data samples count
         size_t count() const;
+        /// number of sample blocks
+        size_t blocks() const;
+        /// get block of samples (normalized into @a buf if normalization is pending)
+        const DataSampleList& block(size_t idx, DataSampleList& buf) const;
+        /// input vector size
+        size_t input_size() const;
+        /// output vector size
+        size_t output_size() const;
         /// data mean
         FeatureVector mean() const;
-        /// data standard deviation
+        /// data standard deviation (the variance, as used for normalization)
         FeatureVector stddev() const;
+        /// data statistics
+        const RunningStats& stats() const { return stats_; }
+        /// number of frames dropped by frame selection while loading
+        size_t dropped() const { return dropped_; }
+        /// number of dropped frames that did not pass the energy gate
+        size_t silent() const { return silent_; }
 
         /// Load data annotations
         static AnnotationType load_annotations(const std::string& filename);
+        /// desired network output for annotations (clamped logarithm of label scores relative to the best one)
+        static FeatureVector desired_output(const AnnotationType& a, const LabelList& labels);
 
         /// get label list
         //const LabelList& get_labels() const;
@@ -109,8 +228,11 @@ class DataSet {
     private:
         //LabelList labels;         ///< label list
         DataSampleList samples;   ///< list of data samples
-        FeatureVector sum, sumsq; ///< stats for data normalization
+        RunningStats stats_;      ///< stats for data normalization
+        size_t dropped_;          ///< frames dropped by frame selection
+        size_t silent_;           ///< frames dropped by the energy gate
         bool normalized;          ///< normalization status
+        FeatureVector norm_mean, norm_scale; ///< pending lazy normalization (empty if none)
 };
 
 #endif // FEATURES_HPP_
@@ -0,0 +1,273 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "inference.hpp"
+#include <cmath>
+#include <stdexcept>
+
+/// compute a dense layer (potential and activation)
+static void dense(const InferencePlan::Layer& l, const Real* x, std::vector<Real>& y)
+{
+    // bias row first, then accumulate the input rows
+    y.assign(l.weights, l.weights + l.outputs);
+    for (size_t i = 0; i < l.inputs; ++i) {
+        const Real* row = l.weights + (i + 1) * l.outputs;
+        const Real xi = x[i];
+        for (size_t o = 0; o < l.outputs; ++o) y[o] += xi * row[o];
+    }
+    l.act->apply(&y[0], y.size());
+}
+
+/// compute a layer with sparse input weights
+static void sparse(const InferencePlan::Layer& l, const Real* x, std::vector<Real>& y)
+{
+    y.assign(l.weights, l.weights + l.outputs);
+    for (size_t i = 0; i < l.inputs; ++i) {
+        const Real xi = x[i];
+        if (xi == 0.0) continue;
+        for (boost::uint32_t k = l.rows[i]; k < l.rows[i + 1]; ++k) y[l.columns[k]] += xi * l.values[k];
+    }
+    l.act->apply(&y[0], y.size());
+}
+
+/// compute a layer by the kernel suitable for it
+static void compute(const InferencePlan::Layer& l, const Real* x, std::vector<Real>& y)
+{
+    if (l.values) sparse(l, x, y);
+    else dense(l, x, y);
+}
+
+const Real InferencePlan::MAX_SPARSE_DENSITY = 0.3;
+
+InferencePlan::InferencePlan() : combination(MEAN), mean_(0), stddev_(0) {}
+
+InferencePlan::InferencePlan(const LayerList& l, const Real* mean, const Real* stddev) :
+    layers_(l), combination(MEAN), mean_(mean), stddev_(stddev)
+{
+    sparsify();
+}
+
+InferencePlan::InferencePlan(const NeuralNet& nn, const Vector& mean, const Vector& stddev) :
+    combination(MEAN), mean_(0), stddev_(0)
+{
+    const NeuralNet::LayerArray& net = nn.get_layers();
+    if (net.empty()) return;
+    if (mean.size() != nn.no_inputs() || stddev.size() != nn.no_inputs())
+        throw std::runtime_error("Normalization does not match the neural network");
+
+    // first layer sees (x - mean) / stddev:
+    // w'[i][o] = w[i][o] / stddev[i], b'[o] = b[o] - sum_i mean[i] * w'[i][o]
+    const NNLayer::Matrix& w0 = net[0].weight_matrix();
+    size_t in = net[0].no_inputs(), out = net[0].no_outputs();
+    std::vector<Real> w(w0.data().begin(), w0.data().end());
+    for (size_t i = 0; i < in; ++i) {
+        Real* row = &w[(i + 1) * out];
+        for (size_t o = 0; o < out; ++o) {
+            row[o] /= stddev[i];
+            w[o] -= mean[i] * row[o];
+        }
+    }
+
+    const ActivationFunc* act = &net[0].activation();
+    for (size_t k = 1; k < net.size(); ++k) {
+        const NNLayer::Matrix& wk = net[k].weight_matrix();
+        size_t next = net[k].no_outputs();
+
+        // an affine layer followed by another one is merged into it if that saves work
+        if (act->id() == linear_func.id() && in * next <= in * out + out * next) {
+            std::vector<Real> m((in + 1) * next, 0.0);
+            for (size_t o = 0; o < next; ++o) m[o] = wk(0, o);
+            for (size_t i = 0; i <= in; ++i)
+                for (size_t h = 0; h < out; ++h)
+                    for (size_t o = 0; o < next; ++o)
+                        m[i * next + o] += w[i * out + h] * wk(h + 1, o);
+            w.swap(m);
+        } else {
+            add(w, in, out, act);
+            w.assign(wk.data().begin(), wk.data().end());
+            in = out;
+        }
+        out = next;
+        act = &net[k].activation();
+    }
+    add(w, in, out, act);
+    sparsify();
+}
+
+void InferencePlan::add(const std::vector<Real>& weights, size_t inputs, size_t outputs, const ActivationFunc* act)
+{
+    storage.push_back(Storage(new std::vector<Real>(weights)));
+    Layer l;
+    l.weights = &(*storage.back())[0];
+    l.inputs = inputs;
+    l.outputs = outputs;
+    l.act = act;
+    layers_.push_back(l);
+}
+
+std::vector<Real> InferencePlan::folded_first() const
+{
+    const Layer& l = layers_.front();
+    std::vector<Real> w(l.weights, l.weights + (l.inputs + 1) * l.outputs);
+    if (mean_)
+        for (size_t i = 0; i < l.inputs; ++i) {
+            Real* row = &w[(i + 1) * l.outputs];
+            for (size_t o = 0; o < l.outputs; ++o) {
+                row[o] /= stddev_[i];
+                w[o] -= mean_[i] * row[o];
+            }
+        }
+    return w;
+}
+
+InferencePlan InferencePlan::stack(const std::vector<InferencePlan>& members, const std::vector<Real>& weights, Combination c)
+{
+    if (members.empty()) throw std::runtime_error("Empty ensemble");
+    size_t in = members[0].input_size(), out = members[0].output_size(), width = 0;
+    for (size_t m = 0; m < members.size(); ++m) {
+        if (!members[m].branches.empty()) throw std::runtime_error("Nested ensembles are not supported");
+        if (members[m].input_size() != in || members[m].output_size() != out)
+            throw std::runtime_error("Ensemble members differ in input or output size");
+        width += members[m].layers_.front().outputs;
+    }
+
+    // stacked first layer: the row of an input holds the weights of all members side by side
+    InferencePlan plan;
+    plan.combination = c;
+    std::vector<Real> w((in + 1) * width);
+    size_t offset = 0;
+    for (size_t m = 0; m < members.size(); ++m) {
+        const InferencePlan& p = members[m];
+        size_t size = p.layers_.front().outputs;
+        std::vector<Real> f = p.folded_first();
+        for (size_t i = 0; i <= in; ++i)
+            std::copy(&f[i * size], &f[i * size] + size, &w[i * width + offset]);
+
+        Branch b;
+        b.offset = offset;
+        b.size = size;
+        b.act = p.layers_.front().act;
+        b.tail.assign(p.layers_.begin() + 1, p.layers_.end());
+        b.weight = (m < weights.size() ? weights[m] : 1.0);
+        plan.branches.push_back(b);
+        plan.storage.insert(plan.storage.end(), p.storage.begin(), p.storage.end());
+        plan.index_storage.insert(plan.index_storage.end(), p.index_storage.begin(), p.index_storage.end());
+        offset += size;
+    }
+    plan.add(w, in, width, &linear_func);
+    plan.sparsify(plan.layers_.back());
+    return plan;
+}
+
+void InferencePlan::sparsify(Layer& l)
+{
+    if (l.values || l.inputs == 0) return;
+    size_t nonzero = 0;
+    const Real* w = l.weights + l.outputs;
+    for (size_t k = 0; k < l.inputs * l.outputs; ++k) if (w[k] != 0.0) ++nonzero;
+    if (nonzero > MAX_SPARSE_DENSITY * l.inputs * l.outputs) return;
+
+    Storage values(new std::vector<Real>());
+    IndexStorage columns(new std::vector<boost::uint32_t>()), rows(new std::vector<boost::uint32_t>(1, 0));
+    values->reserve(nonzero);
+    columns->reserve(nonzero);
+    for (size_t i = 0; i < l.inputs; ++i) {
+        const Real* row = w + i * l.outputs;
+        for (size_t o = 0; o < l.outputs; ++o)
+            if (row[o] != 0.0) {
+                values->push_back(row[o]);
+                columns->push_back(o);
+            }
+        rows->push_back(values->size());
+    }
+    // a layer with no nonzero input weight keeps a valid (unused) pointer
+    if (values->empty()) {
+        values->push_back(0.0);
+        columns->push_back(0);
+    }
+    storage.push_back(values);
+    index_storage.push_back(columns);
+    index_storage.push_back(rows);
+    l.values = &(*values)[0];
+    l.columns = &(*columns)[0];
+    l.rows = &(*rows)[0];
+}
+
+void InferencePlan::sparsify()
+{
+    for (LayerList::iterator l = layers_.begin(); l != layers_.end(); ++l) sparsify(*l);
+}
+
+size_t InferencePlan::sparse_layers() const
+{
+    size_t n = 0;
+    for (LayerList::const_iterator l = layers_.begin(); l != layers_.end(); ++l) if (l->values) ++n;
+    for (size_t b = 0; b < branches.size(); ++b)
+        for (LayerList::const_iterator l = branches[b].tail.begin(); l != branches[b].tail.end(); ++l) if (l->values) ++n;
+    return n;
+}
+
+size_t InferencePlan::output_size() const
+{
+    if (layers_.empty()) return 0;
+    if (branches.empty()) return layers_.back().outputs;
+    const Branch& b = branches.front();
+    return b.tail.empty() ? b.size : b.tail.back().outputs;
+}
+
+InferencePlan::Combination InferencePlan::parse_combination(const std::string& name)
+{
+    if (name == "mean")     return MEAN;
+    if (name == "prob")     return PROB;
+    if (name == "weighted") return WEIGHTED;
+    throw std::runtime_error("Unknown ensemble combination: " + name);
+}
+
+InferencePlan::Vector InferencePlan::exec(const Vector& in, bool normalized) const
+{
+    if (in.size() != input_size()) throw std::runtime_error("Input size does not match the model");
+    if (normalized && folded()) throw std::logic_error("Input normalization is folded into the weights");
+
+    std::vector<Real> x(in.begin(), in.end()), y;
+    if (mean_ && !normalized)
+        for (size_t i = 0; i < x.size(); ++i) x[i] = (x[i] - mean_[i]) / stddev_[i];
+
+    if (branches.empty()) {
+        for (LayerList::const_iterator l = layers_.begin(); l != layers_.end(); ++l) {
+            compute(*l, &x[0], y);
+            x.swap(y);
+        }
+        Vector out(x.size());
+        std::copy(x.begin(), x.end(), out.begin());
+        return out;
+    }
+
+    // ensemble: one pass through the stacked first layer, then the member tails
+    std::vector<Real> h;
+    compute(layers_.front(), &x[0], h);
+    Vector out = boost::numeric::ublas::zero_vector<Real>(output_size());
+    Real total = 0.0;
+    for (size_t b = 0; b < branches.size(); ++b) {
+        const Branch& br = branches[b];
+        x.assign(h.begin() + br.offset, h.begin() + br.offset + br.size);
+        br.act->apply(&x[0], x.size());
+        for (LayerList::const_iterator l = br.tail.begin(); l != br.tail.end(); ++l) {
+            compute(*l, &x[0], y);
+            x.swap(y);
+        }
+
+        Real w = (combination == WEIGHTED ? br.weight : 1.0);
+        for (size_t o = 0; o < x.size(); ++o) out[o] += w * (combination == PROB ? std::exp(x[o]) : x[o]);
+        total += w;
+    }
+    for (size_t o = 0; o < out.size(); ++o) {
+        out[o] /= total;
+        if (combination == PROB) out[o] = std::log(out[o]);
+    }
+    return out;
+}
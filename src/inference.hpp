@@ -0,0 +1,143 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef INFERENCE_HPP_
+#define INFERENCE_HPP_
+
+#include "neuralnet.hpp"
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+/**
+ * Neural network prepared for evaluation.
+ * Layers are plain row-major weight arrays which either belong to the plan
+ * or reference memory owned elsewhere (a mapped model file). When the plan
+ * is built from a network, input normalization is folded into the weights
+ * of the first layer and adjacent affine layers are merged, so a frame is
+ * evaluated without any extra passes.
+ *
+ * A plan may also evaluate an ensemble of networks: first layers of all
+ * members are stacked into a single wider layer computed in one pass,
+ * the remaining layers of every member work on its part of the output.
+ *
+ * Layers with few nonzero input weights (pruned networks) are evaluated
+ * by a sparse kernel: nonzero weights of every input row are kept with
+ * their output indices (CSR) and zero inputs are skipped.
+ */
+class InferencePlan {
+    public:
+        /// layer
+        struct Layer {
+            const Real* weights;        ///< weight matrix, (inputs + 1) x outputs by rows, bias weights first
+            size_t inputs, outputs;     ///< layer size
+            const ActivationFunc* act;  ///< activation function
+            // sparse input weights (0 if the layer is dense)
+            const Real* values;             ///< nonzero input weights by rows
+            const boost::uint32_t* columns; ///< output index of every nonzero weight
+            const boost::uint32_t* rows;    ///< start of every row in values, inputs + 1 entries
+
+            /// dense layer
+            Layer() : weights(0), inputs(0), outputs(0), act(0), values(0), columns(0), rows(0) {}
+        };
+        typedef std::vector<Layer> LayerList;
+        typedef NNLayer::Vector Vector;
+
+        /// combination of ensemble member outputs
+        enum Combination {
+            MEAN,    ///< average of log-scores
+            PROB,    ///< logarithm of the average probability
+            WEIGHTED ///< average of log-scores weighted by member weights
+        };
+
+        /// layers with at most this fraction of nonzero input weights are evaluated as sparse
+        static const Real MAX_SPARSE_DENSITY;
+
+    public:
+        /// empty plan
+        InferencePlan();
+
+        /**
+         * build a plan from a network and its input normalization (folded into the first layer)
+         * @param nn neural network (weights are copied)
+         * @param mean input mean
+         * @param stddev input standard deviation
+         */
+        InferencePlan(const NeuralNet& nn, const Vector& mean, const Vector& stddev);
+
+        /**
+         * build a plan referencing external weights
+         * @param layers network layers (weights must outlive the plan)
+         * @param mean input mean, normalization is done separately for every frame
+         * @param stddev input standard deviation
+         */
+        InferencePlan(const LayerList& layers, const Real* mean, const Real* stddev);
+
+        /**
+         * build an ensemble plan evaluating all members in a single pass
+         * @param members member plans (weights they reference must outlive the ensemble)
+         * @param weights member weights for WEIGHTED combination
+         * @param c how member outputs are combined
+         */
+        static InferencePlan stack(const std::vector<InferencePlan>& members, const std::vector<Real>& weights, Combination c);
+
+        /**
+         * compute network output for single data frame
+         * @param in input vector
+         * @param normalized input is normalized already (possible only if normalization is not folded)
+         */
+        Vector exec(const Vector& in, bool normalized = false) const;
+
+        /// plan layers (the stacked first layer of an ensemble)
+        const LayerList& layers() const { return layers_; }
+        /// input vector size
+        size_t input_size() const { return layers_.empty() ? 0 : layers_.front().inputs; }
+        /// output vector size
+        size_t output_size() const;
+        /// input normalization is folded into the weights
+        bool folded() const { return !mean_; }
+        /// number of layers evaluated by the sparse kernel
+        size_t sparse_layers() const;
+        /// number of networks evaluated
+        size_t members() const { return branches.empty() ? (layers_.empty() ? 0 : 1) : branches.size(); }
+
+        /// parse combination name (mean, prob, weighted)
+        static Combination parse_combination(const std::string& name);
+
+    private:
+        /// ensemble member working on a part of the stacked first layer output
+        struct Branch {
+            size_t offset, size;       ///< part of the stacked layer output
+            const ActivationFunc* act; ///< first layer activation function
+            LayerList tail;            ///< remaining layers
+            Real weight;               ///< output weight
+        };
+        typedef boost::shared_ptr<std::vector<Real> > Storage;
+        typedef boost::shared_ptr<std::vector<boost::uint32_t> > IndexStorage;
+
+        /// add a layer owned by the plan
+        void add(const std::vector<Real>& weights, size_t inputs, size_t outputs, const ActivationFunc* act);
+        /// first layer weights with the input normalization folded in
+        std::vector<Real> folded_first() const;
+        /// add sparse input weights to a layer if it has few nonzero ones
+        void sparsify(Layer& l);
+        /// sparsify all layers
+        void sparsify();
+
+    private:
+        LayerList layers_;
+        std::vector<Branch> branches; ///< ensemble members (empty for a single network)
+        Combination combination;
+        std::vector<Storage> storage; ///< weights owned by the plan (shared by copies, never modified)
+        std::vector<IndexStorage> index_storage; ///< sparse weight indices owned by the plan
+        const Real *mean_, *stddev_;  ///< separate input normalization (0 if folded)
+};
+
+#endif // INFERENCE_HPP_
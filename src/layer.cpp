@@ -12,6 +12,7 @@
 #include <cmath>
 #include <ctime>
 #include <cstdlib>
+#include <algorithm>
 
 #include <boost/numeric/ublas/vector_proxy.hpp>
 #include <boost/numeric/ublas/io.hpp>
@@ -24,22 +25,38 @@ using namespace boost::numeric::ublas;
 
 LinearFunc::VecType LinearFunc:: f(const VecType& v) const { return v; }
 LinearFunc::VecType LinearFunc::df(const VecType& in, const NNLayer& nn, const VecType& out) const { return ScalarType(out.size(), 1.0); }
+void LinearFunc::apply(NumType*, size_t) const { }
 std::string LinearFunc::name() const { return "linear"; }
+unsigned LinearFunc::id() const { return 0; }
 
 SigmoidFunc::VecType SigmoidFunc:: f(const VecType& v) const { VecType r(v.size()); std::transform(v.begin(), v.end(), r.begin(), sigmoid); return r; }
 SigmoidFunc::VecType SigmoidFunc::df(const VecType& in, const NNLayer& nn, const VecType& out) const { return element_prod(ScalarType(out.size(), 1.0) - out, out); }
+void SigmoidFunc::apply(NumType* v, size_t n) const { std::transform(v, v + n, v, sigmoid); }
 std::string SigmoidFunc::name() const { return "sigmoid"; }
+unsigned SigmoidFunc::id() const { return 1; }
 
 SigmoidFunc::VecType LogSigmoidFunc:: f(const VecType& v) const { VecType r(v.size()); std::transform(v.begin(), v.end(), r.begin(), logsigmoid); return r; }
 SigmoidFunc::VecType LogSigmoidFunc::df(const VecType& in, const NNLayer& nn, const VecType& v) const
     { VecType r(v.size()); std::transform(v.begin(), v.end(), r.begin(), static_cast<Real(*)(Real)>(std::exp)); return ScalarType(r.size(), 1.0) - r; }
+void LogSigmoidFunc::apply(NumType* v, size_t n) const { std::transform(v, v + n, v, logsigmoid); }
 std::string LogSigmoidFunc::name() const { return "logsigmoid"; }
+unsigned LogSigmoidFunc::id() const { return 2; }
 
 LinearFunc linear_func;
 SigmoidFunc sigmoid_func;
 LogSigmoidFunc logsigmoid_func;
 
 NNLayer::NNLayer(size_t inputs, size_t outputs, ActivationFunc& a) : act(&a), weights(inputs + 1, outputs)
+{
+    init_activations();
+}
+
+NNLayer::NNLayer(const Matrix& w, const ActivationFunc& a) : act(&a), weights(w)
+{
+    init_activations();
+}
+
+void NNLayer::init_activations()
 {
     // lazy act_map initialisation with default act. funcs
     if (act_map.size() == 0) {
@@ -57,17 +74,61 @@ NNLayer::Vector NNLayer::potential(const Vector& in) const
 
 NNLayer::Vector NNLayer::exec(const Vector& in) const { return act->f(potential(in)); }
 
-void NNLayer::randomize(Real lo, Real hi)
+/// generator of random weights shared by all layers
+static boost::mt19937& weight_rng()
 {
     static boost::mt19937 rng(time(0));
+    return rng;
+}
+
+void NNLayer::seed(unsigned s) { weight_rng().seed(s); }
+
+void NNLayer::randomize(Real lo, Real hi)
+{
     boost::uniform_real<Real> dist(lo, hi);
-    boost::variate_generator<boost::mt19937&, boost::uniform_real<> > random(rng, dist);
+    boost::variate_generator<boost::mt19937&, boost::uniform_real<> > random(weight_rng(), dist);
 
     for (size_t i1 = 0; i1 < weights.size1(); ++i1)
         for (size_t i2 = 0; i2 < weights.size2(); ++i2)
             weights(i1, i2) = random();
 }
 
+void NNLayer::prune(Real fraction, const Vector& input_scale)
+{
+    size_t inputs = no_inputs(), outputs = no_outputs();
+    size_t n = static_cast<size_t>(fraction * inputs * outputs + 0.5);
+    if (n == 0) return;
+
+    // the threshold is the n-th smallest importance
+    std::vector<Real> importance;
+    importance.reserve(inputs * outputs);
+    for (size_t i = 0; i < inputs; ++i)
+        for (size_t o = 0; o < outputs; ++o)
+            importance.push_back(std::fabs(weights(i + 1, o)) * (input_scale.size() ? input_scale(i) : 1.0));
+    std::vector<Real> sorted(importance);
+    n = std::min(n, sorted.size());
+    std::nth_element(sorted.begin(), sorted.begin() + (n - 1), sorted.end());
+    Real threshold = sorted[n - 1];
+
+    // ties at the threshold are pruned only until n weights are zero
+    size_t below = 0;
+    for (size_t k = 0; k < importance.size(); ++k) if (importance[k] < threshold) ++below;
+    size_t ties = n - below;
+    for (size_t i = 0, k = 0; i < inputs; ++i)
+        for (size_t o = 0; o < outputs; ++o, ++k)
+            if (importance[k] < threshold || (importance[k] == threshold && ties && ties--))
+                weights(i + 1, o) = 0.0;
+}
+
+size_t NNLayer::zeros() const
+{
+    size_t n = 0;
+    for (size_t i = 1; i < weights.size1(); ++i)
+        for (size_t o = 0; o < weights.size2(); ++o)
+            if (weights(i, o) == 0.0) ++n;
+    return n;
+}
+
 void NNLayer::load(std::istream& is)
 {
     std::string actname;
@@ -85,8 +146,21 @@ void NNLayer::swap(NNLayer& l)
 std::istream& operator>>(std::istream& is, NNLayer& nn) { nn.load(is); return is; }
 std::ostream& operator<<(std::ostream& os, const NNLayer& nn) { return os << nn.activation().name() << " " << nn.weight_matrix(); }
 
-void NNLayer::register_activation(const ActivationFunc& f) { act_map[f.name()] = &f; }
+void NNLayer::register_activation(const ActivationFunc& f)
+{
+    act_map[f.name()] = &f;
+    if (act_ids.size() <= f.id()) act_ids.resize(f.id() + 1, 0);
+    act_ids[f.id()] = &f;
+}
+
+const ActivationFunc* NNLayer::activation_by_id(unsigned id)
+{
+    init_activations();
+    return (id < act_ids.size() ? act_ids[id] : 0);
+}
+
 NNLayer::ActFuncMap NNLayer::act_map = NNLayer::ActFuncMap();
+std::vector<const ActivationFunc*> NNLayer::act_ids;
 
 NNLayer::Vector NNLayer::input_vec(const Vector& in)
 {
@@ -96,11 +170,17 @@ NNLayer::Vector NNLayer::input_vec(const Vector& in)
     return input;
 }
 
-NNLayer::Teacher::Teacher(NNLayer& nn, bool randomize)
+NNLayer::Teacher::Teacher(NNLayer& nn, bool randomize, bool keep_zeros)
     : n_data(0), dw(zero_matrix<Numeric>(nn.weights.size1(), nn.weights.size2())), layer(&nn)
 {
     if (randomize) layer->randomize();
     w2 = nn.weights;
+    if (keep_zeros && nn.zeros()) {
+        mask = scalar_matrix<Numeric>(dw.size1(), dw.size2(), 1.0);
+        for (size_t i = 1; i < mask.size1(); ++i)
+            for (size_t o = 0; o < mask.size2(); ++o)
+                if (nn.weights(i, o) == 0.0) mask(i, o) = 0.0;
+    }
 }
 
 void NNLayer::Teacher::sample(const Vector& in, const Vector& out, const Vector& dout)
@@ -122,6 +202,7 @@ void NNLayer::Teacher::teach(Numeric learning_rate)
                   + element_prod(scalar_matrix<Numeric>(dw.size1(), dw.size2(), momentum), layer->weights - w2);
     w2 = layer->weights; // store previous weights
     layer->weights += update;
+    if (mask.size1()) layer->weights = element_prod(layer->weights, mask);
     // zero dw matrix
     dw = scalar_matrix<Numeric>(dw.size1(), dw.size2(), 0.0);
     n_data = 0;
@@ -47,8 +47,18 @@ class ActivationFunc {
          */
         virtual VecType df(const VecType& in, const NNLayer& nn, const VecType& out) const = 0;
 
+        /**
+         * compute activation function in place
+         * @param v potential values
+         * @param n number of values
+         */
+        virtual void apply(NumType* v, size_t n) const = 0;
+
         /// activation function name
         virtual std::string name() const = 0;
+
+        /// activation function numeric identifier (used in binary model files)
+        virtual unsigned id() const = 0;
 };
 
 /**
@@ -58,7 +68,9 @@ class LinearFunc : public ActivationFunc {
     public:
         virtual VecType  f(const VecType& v) const;
         virtual VecType df(const VecType& in, const NNLayer& nn, const VecType& out) const;
+        virtual void apply(NumType* v, size_t n) const;
         virtual std::string name() const;
+        virtual unsigned id() const;
 };
 
 /**
@@ -68,7 +80,9 @@ class SigmoidFunc : public ActivationFunc {
     public:
         virtual VecType  f(const VecType& v) const;
         virtual VecType df(const VecType& in, const NNLayer& nn, const VecType& out) const;
+        virtual void apply(NumType* v, size_t n) const;
         virtual std::string name() const;
+        virtual unsigned id() const;
 };
 
 /**
@@ -78,7 +92,9 @@ class LogSigmoidFunc : public ActivationFunc {
     public:
         virtual VecType  f(const VecType& v) const;
         virtual VecType df(const VecType& in, const NNLayer& nn, const VecType& out) const;
+        virtual void apply(NumType* v, size_t n) const;
         virtual std::string name() const;
+        virtual unsigned id() const;
 };
 
 /// linear activation function instance
@@ -109,6 +125,13 @@ class NNLayer {
          */
         NNLayer(size_t inputs, size_t outputs, ActivationFunc& a);
 
+        /**
+         * Neural network layer with given weights
+         * @param w weight matrix (bias weights in the first row)
+         * @param a activation function
+         */
+        NNLayer(const Matrix& w, const ActivationFunc& a);
+
         /**
          * Compute potential of neurons in the layer
          * @param in input vector
@@ -128,6 +151,19 @@ class NNLayer {
          */
         void randomize(Real lo = -1.0, Real hi = +1.0);
 
+        /// seed the generator of random weights (seeded by the current time by default)
+        static void seed(unsigned s);
+
+        /**
+         * zero input weights of the least importance (bias weights are kept)
+         * @param fraction fraction of input weights to be zero afterwards
+         * @param input_scale typical magnitude of every input, importance of a weight
+         *        is its magnitude times the input scale (plain magnitude if empty)
+         */
+        void prune(Real fraction, const Vector& input_scale = Vector());
+        /// number of zero input weights
+        size_t zeros() const;
+
         /// get weight matrix
         const Matrix& weight_matrix() const { return weights; }
         /// get activation function
@@ -150,8 +186,12 @@ class NNLayer {
          */
         class Teacher {
             public:
-                /// Create a learning context for a layer
-                explicit Teacher(NNLayer& nn, bool randomize = true);
+                /**
+                 * Create a learning context for a layer
+                 * @param randomize start from random weights
+                 * @param keep_zeros zero weights are not trained (keeps a pruned layer sparse)
+                 */
+                explicit Teacher(NNLayer& nn, bool randomize = true, bool keep_zeros = false);
                 /// present a training dataset sample and difference from desired value, thus updating @a dw
                 void sample(const Vector& in, const Vector& out, const Vector& dout);
                 /// present a training dataset sample and difference from desired value, thus updating @a dw
@@ -164,6 +204,7 @@ class NNLayer {
                 size_t n_data;  ///< data samples presented so far
                 Matrix dw;      ///< accumulated weight deltas
                 Matrix w2;      ///< previous weight matrix
+                Matrix mask;    ///< trained weights (empty if all are)
                 NNLayer* layer; ///< layer reference
         };
 
@@ -173,12 +214,16 @@ class NNLayer {
     public:
         /// register activation function for the factory
         static void register_activation(const ActivationFunc& f);
+        /// get activation function by its numeric identifier (0 if unknown)
+        static const ActivationFunc* activation_by_id(unsigned id);
 
     private:
         const ActivationFunc* act; ///< activation function 
         Matrix weights;            ///< weight matrix
     private:
         static ActFuncMap act_map; ///< activation function factory map
+        static std::vector<const ActivationFunc*> act_ids; ///< activation functions by identifier
+        static void init_activations(); ///< register default activation functions
         static Vector input_vec(const Vector& in); ///< prepend zero-th input element (value 1.0)
 };
 
@@ -8,13 +8,29 @@
 
 
 #include "classifier.hpp"
+#include "datastream.hpp"
+#include "manifest.hpp"
+#include "server.hpp"
+#include "pipeline.hpp"
+#include "evaluate.hpp"
+#include "profile.hpp"
+#include "synth.hpp"
+#include "tune.hpp"
+#include "cluster.hpp"
+#include "projection.hpp"
+#include "timer.hpp"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/filesystem.hpp>
 
 using std::string;
 
@@ -26,33 +42,234 @@ struct params {
     string prog;           // program name
     string out_file;       // neural net file
     string cls_file;       // classifier filename
+    StringList cls_files;  // all classifier filenames (an ensemble if more than one)
+    string combination;    // ensemble output combination
     string data_dir;       // data dir to process
     StringList files;      // classification files
     StringList labels;     // data labels
-    bool verbose;          // verbosity
+    bool verbose;          // verbosity (phase timing report)
+    string trace_file;     // phase trace output
+    bool binary;           // write dataset as a binary block stream
+    DataStream::Encoding encoding; // binary stream input encoding
     size_t hidden_neurons; // number of hidden neurons
     size_t chunk_size;     // size of BP learning chunks
     size_t try_count;      // how many NNs to train to choose the best one
+    size_t xval_sample;    // crossvalidation subsample size (0 = whole set)
+    Real prune_fraction;   // fraction of weights to prune
+    bool sensitivity;      // prune by weight sensitivity instead of magnitude
+    bool fine_tune;        // train a pruned network further
+    size_t threads;        // number of worker threads
+    size_t workers;        // number of training processes
+    string batch_method;   // full-batch training method (chunked backpropagation if empty)
+    string init_file;      // classifier to continue training of
+    string replay_file;    // old training data replayed with new ones
+    size_t replay_samples; // number of old samples replayed (0 = as many as new ones)
+    size_t projection;     // number of principal components the inputs are projected onto (0 = none)
+    bool whiten;           // scale principal components to unit variance
+    FrameSelection selection; // frames of records to keep in datasets
+    ClassifyPipeline::Options pipeline; // batch classification threads
+    Real window, hop;      // segment window length and hop in seconds
+    size_t top_k;          // evaluation top-k accuracy
+    string hidden_list, chunk_list, rate_list; // tuned hyperparameter values
+    size_t records;        // number of synthetic records
+    size_t tune_budget;    // number of tuned configurations picked at random (0 = all)
+    size_t dims;           // synthetic dataset input size
+    Real separation;       // synthetic genre cluster distance
+    unsigned seed;         // random seed
+    bool seeded;           // seed was given
+    bool verify;           // check checksums of binary models
 };
 
 /// write program help to stdout
 void prog_help(params& p)
 {
     std::cout << p.prog << " <mode> <switches>\n"
-              "    mode is one of: train, classify, dataset, test, help\n"
+              "    mode is one of: train, tune, prune, distill, classify, evaluate, batch, segments, serve, convert, dataset, append, project, synth, features, help\n"
               "    syntax for mode options is as follows:\n"
               "      train -o <out_neural_net_file> -l <colon-separated_genre_labels> -h <hidden_neuron_count> <path_to/features.dat+>\n"
               "          train neural network\n"
               "          up to three feature datasets can be specified: training, testing, crossvalidation (in this order)\n"
-              "      classify -f <neural_net_file> <wav_file+>\n"
+              "          -t <count> trains several candidates and keeps the best one, all of them are listed\n"
+              "          in <out_neural_net_file>.ensemble\n"
+              "          -x <samples> estimates the crossvalidation error on a stratified random subsample and\n"
+              "          evaluates the whole set only when the estimate can not tell whether to count a miss,\n"
+              "          restore the previous network or stop (also in tune mode)\n"
+              "          --init <neural_net_file> continues training of an existing network (warm start, no -h needed),\n"
+              "          adapted to the normalization of the training data, from learning rate -R (0.1 by default, 0.5 otherwise)\n"
+              "          --replay <old_features.dat> mixes the training data (e.g. features of new records only) with\n"
+              "          a random sample of the old ones, --replay-samples <count> of them (as many as new ones by default)\n"
+              "          a dataset projected by the project mode (or dataset --pca) is recognized by its\n"
+              "          <path_to/features.dat>.projection file, the written network takes unprojected inputs (also in tune)\n"
+              "          -B rprop|lbfgs trains by iRPROP+ or L-BFGS on the exact gradient of the whole training set\n"
+              "          (summed on -j threads) instead of chunked backpropagation, one update per New Bob iteration;\n"
+              "          the learning rate -R limits the change of a weight per update\n"
+              "          -W <processes> trains data parallel in several processes connected by a Unix domain socket:\n"
+              "          each one presents its part of every block, weights are averaged after every block and\n"
+              "          crossvalidation is split among them, the first process controls New Bob\n"
+              "      tune -o <out_neural_net_file> -l <colon-separated_genre_labels> -H <hidden_neuron_counts> [-C <chunk_sizes>]\n"
+              "            [-R <learning_rates>] [--budget <count>] [-j <threads>] <path_to/features.dat+>\n"
+              "          train networks of all combinations of the comma-separated hyperparameter values (or --budget of them\n"
+              "          picked at random) on -j threads; after every round of New Bob iterations the worse half\n"
+              "          by crossvalidation error is dropped and the rest trained twice as long, until one is left\n"
+              "          writes the converged network with the lowest test error and prints a table of all of them\n"
+              "      prune -f <neural_net_file> -o <out_neural_net_file> -P <fraction> [-M magnitude|sensitivity] [-F [-R <rate>] [-B rprop|lbfgs]] [-b]\n"
+              "            <path_to/features.dat+>\n"
+              "          zero the given fraction of input weights of every layer, those of the lowest magnitude or of the\n"
+              "          lowest magnitude times the typical input magnitude (sensitivity); -F fine-tunes the remaining\n"
+              "          weights on the datasets (training, testing, crossvalidation as in train, use the original ones)\n"
+              "          reports sparsity, frame accuracy and speed of the original and pruned networks on the last\n"
+              "          dataset; layers with at most 30% nonzero weights are evaluated by a sparse kernel\n"
+              "      distill -f <neural_net_file> [-f <neural_net_file> ...] [-E <combination>] -o <out_neural_net_file>\n"
+              "            -h <hidden_neuron_count> [-R <rate>] [-b] <path_to/features.dat+>\n"
+              "          train a small network to reproduce the outputs of a larger network or an ensemble:\n"
+              "          the teacher classifies the training set once and the student is trained on its outputs,\n"
+              "          New Bob is controlled by the crossvalidation set with the original labels (datasets as in train)\n"
+              "          reports frame accuracy and speed of the teacher and the student on the last dataset\n"
+              "      classify -f <neural_net_file> [-f <neural_net_file> ...] [-E <combination>] <wav_file+>\n"
               "          classify an audio record\n"
-              "      dataset -l <colon-separated_genre_labels> -d <dataset_directory> -o <output_feature_file>\n"
-              "          preprocess a dataset\n"
+              "          the neural net file may be in the text or binary model format\n"
+              "          several files or an ensemble list (<out_neural_net_file>.ensemble written by train -t)\n"
+              "          are evaluated together as an ensemble; -E selects how their outputs are combined:\n"
+              "          mean (log-scores, default), prob (probabilities) or weighted (by inverse test error)\n"
+              "      evaluate -f <neural_net_file> -d <dataset_directory> [-K <k>] [-o <json_file>] [-p <readers>:<extractors>:<inference>]\n"
+              "          classify all annotated records in a directory in parallel and report top-1 and top-k\n"
+              "          accuracy, confusion matrix, mean error and timing (also as JSON with -o)\n"
+              "      batch -f <neural_net_file> [-o <output_file>] [-p <readers>:<extractors>:<inference>] [<wav_file+>]\n"
+              "          classify many files at once, reading, feature extraction and inference run concurrently\n"
+              "          writes a tab-separated line per file: name, frames and log-score of every label\n"
+              "          file names are read from the standard input if none are given\n"
+              "      segments -f <neural_net_file> [-w <window_seconds>] [-k <hop_seconds>] [-o <output_file>] <wav_file+>\n"
+              "          genre timeline: tab-separated scores of sliding windows (5 s long every 1 s by default)\n"
+              "          with the best scoring label; every frame is classified only once\n"
+              "      serve -f <neural_net_file> -o <socket_file> [-j <workers>]\n"
+              "          keep the classifier loaded and serve requests on a Unix domain socket:\n"
+              "          'classify <wav_file>', 'pcm <rate> <samples>' followed by 16-bit mono samples,\n"
+              "          'labels' and 'quit'; replies are 'ok <frames> <label>:<log_score>...' or 'error <message>'\n"
+              "      convert -f <neural_net_file> -o <output_file>\n"
+              "          convert a text neural net file into the binary model format (memory-mapped on load)\n"
+              "          or a binary one back into text\n"
+              "      dataset -l <colon-separated_genre_labels> -d <dataset_directory> -o <output_feature_file> [-b [-e <encoding>]] [-j <threads>]\n"
+              "          preprocess a dataset, extracting features of several files at once with -j\n"
+              "          frames can be decimated by -s <stride>, -m <min_distance> (in stddevs) and -n <frames_per_record>\n"
+              "          -g <dB> skips frames that much quieter than the loud frames of their record (silence, fades)\n"
+              "          before their features are computed (also in classify, batch and evaluate)\n"
+              "          -b writes a binary block stream which is read from disk block by block during training\n"
+              "          its inputs are encoded as real (default), half (16-bit float) or int16 (16-bit integer) by -e\n"
+              "          --pca <k> or --whiten <k> projects the inputs as in the project mode (text datasets only)\n"
+              "      project (--pca <k> | --whiten <k>) [-b [-e <encoding>]] [-j <threads>] <features.dat> <out_features.dat>\n"
+              "            [<features.dat> <out_features.dat> ...]\n"
+              "          project the inputs onto their k principal components (--whiten also scales them to unit variance),\n"
+              "          fitted to the covariance of the first dataset computed on -j threads; all datasets are projected\n"
+              "          the same way and the projection is written to <out_features.dat>.projection of the first one\n"
+              "      append -d <dataset_directory> -o <binary_feature_file> [-l <colon-separated_genre_labels>]\n"
+              "          add records not yet in a binary dataset (as listed in <binary_feature_file>.manifest)\n"
+              "      reduction -l <colon-separated_genre_labels> -d <dataset_directory> -h <hidden_neuron_count> [-s|-m|-n ...]\n"
+              "          report crossvalidation error of classifiers trained on decimated datasets\n"
+              "          (every fifth record is held out for crossvalidation)\n"
+              "      synth -l <colon-separated_genre_labels> [-d <corpus_directory>] [-o <output_feature_file> [-b [-e <encoding>]]]\n"
+              "            [-N <records>] [-w <record_seconds>] [-D <dimensions>] [-S <separation>]\n"
+              "          generate a synthetic workload: a corpus of .wav and .tag records with -d and/or a feature\n"
+              "          dataset of the same structure (-D inputs, genre clusters -S stddevs apart) with -o\n"
+              "          the output depends only on the options and the seed (1 unless --seed is given)\n"
               "      features <wav_file+>\n"
               "          show features for given files\n"
+              "    in every mode, -v reports time spent in processing phases and event counts on exit\n"
+              "    and -T <trace_file> writes the phases in the Chrome trace format (chrome://tracing)\n"
+              "    --seed <number> makes weight initialization and shuffling repeatable\n"
+              "    --verify checks the checksum of binary models when they are loaded (only their header otherwise,\n"
+              "    so that their weights are mapped lazily)\n"
               << std::endl;
 }
 
+/// records (.wav files without extension) in a directory, sorted by name
+std::vector<string> list_records(const string& dirname)
+{
+    using boost::filesystem::directory_iterator;
+
+    boost::filesystem::path dirpath(dirname);
+    if (!exists(dirpath)) throw std::runtime_error("Directory '" + dirname + "' does not exist.");
+    std::vector<string> files;
+    for (directory_iterator dir(dirpath), dirend; dir != dirend; ++dir)
+        if (dir->path().extension() == ".wav")
+            files.push_back((dir->path().parent_path() / dir->path().stem()).string());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/**
+ * Extract features of records in the data directory into a binary stream,
+ * one record at a time. Records are listed in the stream manifest and
+ * when appending, only records not listed there yet are processed.
+ */
+void update_stream(params& p, bool append)
+{
+    using boost::filesystem::directory_iterator;
+
+    boost::filesystem::path dirpath(p.data_dir);
+    if (!exists(dirpath)) throw std::runtime_error("Directory '" + p.data_dir + "' does not exist.");
+
+    string manifest_file = DataManifest::filename_for(p.out_file);
+    DataManifest manifest(p.labels);
+    if (append) {
+        manifest.load(manifest_file);
+        if (p.labels.empty()) p.labels = manifest.labels();
+        else if (p.labels != manifest.labels()) throw std::runtime_error("Labels do not match the dataset labels.");
+    }
+
+    std::cout << "=== Loading data, extracting features & writing stream" << std::endl;
+    DataStream::Writer out(p.out_file, append, p.encoding);
+    size_t added = 0, skipped = 0, silent = 0;
+    for (directory_iterator dir(dirpath), dirend; dir != dirend; ++dir) {
+        if (dir->path().extension() != ".wav") continue;
+        string base = (dir->path().parent_path() / dir->path().stem()).string();
+
+        DataManifest::Entry e;
+        DataManifest::Status status = manifest.check(base, e);
+        if (status != DataManifest::NEW) {
+            if (status == DataManifest::CHANGED)
+                std::cout << "!!! " << dir->path().string() << " changed since it was added, rebuild the dataset to update it" << std::endl;
+            else
+                manifest.add(base, e); // refresh file times, so that contents are not checksummed next time
+            ++skipped;
+            continue;
+        }
+
+        std::cout << "--- " << dir->path().string() << std::endl;
+        DataSet data;
+        data.load(base, p.labels, p.selection);
+        out.add(data);
+        e.frames = data.count();
+        manifest.add(base, e);
+        silent += data.silent();
+        ++added;
+    }
+    out.close();
+    manifest.save(manifest_file);
+    std::cout << "=== DONE (" << added << " records added, " << skipped << " skipped, "
+              << out.count() << " samples";
+    if (silent) std::cout << ", " << silent << " silent frames skipped";
+    std::cout << ")" << std::endl;
+}
+
+/// add new records to a binary dataset stream
+void do_append(params& p)
+{
+    if (p.data_dir.empty())    throw std::runtime_error("Specify data directory.");
+    if (p.out_file.empty())    throw std::runtime_error("Specify dataset filename.");
+    update_stream(p, true);
+}
+
+/// fit the projection chosen by --pca or --whiten to normalized data
+Projection fit_projection(const params& p, const SampleSource& data)
+{
+    std::cout << "=== Fitting " << (p.whiten ? "whitening" : "PCA") << " projection on " << p.threads << " threads" << std::endl;
+    Projection pr;
+    pr.fit(data, p.projection, p.whiten, p.threads);
+    std::cout << "=== Kept " << pr.output_size() << " of " << pr.input_size() << " dimensions ("
+              << 100.0 * pr.explained() << "% of variance)" << std::endl;
+    return pr;
+}
+
 /// process data set
 void do_dataset(params& p)
 {
@@ -60,11 +277,28 @@ void do_dataset(params& p)
     if (p.data_dir.empty())    throw std::runtime_error("Specify data directory.");
     if (p.out_file.empty())    throw std::runtime_error("Specify output filename.");
 
+    if (p.binary) {
+        if (p.projection) throw std::runtime_error("Binary datasets are projected by the project mode.");
+        update_stream(p, false);
+        return;
+    }
+
     DataSet data;
     std::cout << "=== Loading data & extracting features" << std::endl;
-    data.load_dir(p.data_dir, p.labels);
+    data.load_dir(p.data_dir, p.labels, p.threads, p.selection);
+    if (data.dropped())
+        std::cout << "=== Kept " << data.count() << " of " << (data.count() + data.dropped()) << " frames"
+                  << (data.silent() ? " (" + boost::lexical_cast<string>(data.silent()) + " silent)" : string()) << std::endl;
     std::cout << "=== Normalizing data" << std::endl;
     data.normalize_all();
+    if (p.projection) {
+        Projection pr = fit_projection(p, data);
+        DataSet projected;
+        pr.apply(data, projected);
+        projected.normalize_all();
+        data = projected;
+        pr.save(Projection::filename_for(p.out_file));
+    }
     std::cout << "=== Shuffling data" << std::endl;
     data.shuffle();
     std::cout << "=== Writing data" << std::endl;
@@ -72,62 +306,249 @@ void do_dataset(params& p)
     std::cout << "=== DONE" << std::endl;
 }
 
+typedef boost::shared_ptr<SampleSource> DataSourcePtr;
+
+/// open a data file, binary streams are read from disk, text datasets are loaded into memory
+DataSourcePtr open_data(const string& filename)
+{
+    if (DataStream::is_stream(filename)) return DataSourcePtr(new DataStream(filename));
+    DataSet* data = new DataSet();
+    DataSourcePtr ptr(data);
+    data->load_tmp(filename);
+    return ptr;
+}
+
+/// project datasets onto principal components of the first one
+void project(params& p)
+{
+    if (p.projection == 0)     throw std::runtime_error("Specify number of dimensions by --pca or --whiten.");
+    if (p.files.size() < 2 || p.files.size() % 2) throw std::runtime_error("Specify pairs of input and output data files.");
+
+    Projection pr;
+    for (size_t f = 0; f < p.files.size(); f += 2) {
+        std::cout << "=== Loading " << p.files[f] << std::endl;
+        DataSourcePtr data = open_data(p.files[f]);
+        if (f == 0) {
+            pr = fit_projection(p, *data);
+            pr.save(Projection::filename_for(p.files[1]));
+        }
+        std::cout << "=== Writing " << p.files[f + 1] << std::endl;
+        if (p.binary) {
+            DataStream::Writer writer(p.files[f + 1], false, p.encoding);
+            pr.apply(*data, writer);
+            writer.close();
+        } else {
+            DataSet projected;
+            pr.apply(*data, projected);
+            projected.normalize_all();
+            projected.write_tmp(p.files[f + 1]);
+        }
+    }
+    std::cout << "=== DONE" << std::endl;
+}
+
+/**
+ * load the projection of a training data file, if it was projected
+ * @return whether there is one
+ */
+bool load_projection(const string& filename, Projection& pr, std::ostream& out)
+{
+    string name = Projection::filename_for(filename);
+    if (!boost::filesystem::exists(name)) return false;
+    pr.load(name);
+    out << "=== Inputs projected by " << name << " (" << pr.output_size() << " of " << pr.input_size() << " dimensions)" << std::endl;
+    return true;
+}
+
+/// parse a comma-separated list of values
+template <typename T>
+std::vector<T> parse_list(const string& str)
+{
+    params::StringList items;
+    std::vector<T> values;
+    boost::algorithm::split(items, str, boost::algorithm::is_any_of(","));
+    for (size_t i = 0; i < items.size(); ++i)
+        if (!items[i].empty()) values.push_back(boost::lexical_cast<T>(items[i]));
+    return values;
+}
+
 /// training
 void training(params& p)
 {
-    if (p.hidden_neurons == 0) throw std::runtime_error("Specify number of hidden layser neurons.");
+    // a warm start continues training of an existing network
+    Classifier init;
+    bool warm = !p.init_file.empty();
+    if (warm) {
+        init.load_file(p.init_file, false, p.verify);
+        if (init.members() > 1) throw std::runtime_error("Training can not start from an ensemble.");
+        if (p.labels.empty()) p.labels = init.labels();
+        if (p.labels != init.labels()) throw std::runtime_error("Labels do not match the labels of " + p.init_file);
+    }
+
+    if (p.hidden_neurons == 0 && !warm) throw std::runtime_error("Specify number of hidden layser neurons.");
     if (p.out_file.empty())    throw std::runtime_error("Specify classifier output filename.");
     if (p.files.size() < 1)    throw std::runtime_error("Specify training, testing and crossvalidation data file.");
     if (p.labels.size() == 0)  throw std::runtime_error("Specify output labels.");
+    bool batch = !p.batch_method.empty();
+    BatchOptimizer::Method method = (batch ? BatchOptimizer::parse_method(p.batch_method) : BatchOptimizer::RPROP);
 
-    std::cout << "=== Loading data" << std::endl;
-    DataSet train, test_d, xval_d;
-    train.load_tmp(p.files[0]);
-    if (p.files.size() >= 2) test_d.load_tmp(p.files[1]);
-    if (p.files.size() >= 3) xval_d.load_tmp(p.files[2]);
-    DataSet& xval = (xval_d.count() ? xval_d : train);
-    DataSet& test = (test_d.count() ? test_d : xval);
+    // worker processes are started before any data are opened, each of them reads its own copy
+    std::auto_ptr<Cluster> cluster;
+    if (p.workers > 1) {
+        std::cout << "=== Starting " << p.workers << " training processes" << std::endl;
+        cluster = Cluster::spawn(p.workers);
+    }
+    bool worker = (cluster.get() && cluster->rank() > 0);
+    std::ostream quiet(0);
+    std::ostream& out = (worker ? quiet : std::cout);
+
+    out << "=== Loading data" << std::endl;
+    DataSourcePtr train_d = open_data(p.files[0]), test_d, xval_d;
+    if (p.files.size() >= 2) test_d = open_data(p.files[1]);
+    if (p.files.size() >= 3) xval_d = open_data(p.files[2]);
+    if (!p.replay_file.empty()) {
+        // new data are mixed with a random sample of the old ones (the same in every process, as
+        // they all inherit the generator state), by default as many as there are new samples
+        DataSourcePtr old_d = open_data(p.replay_file);
+        size_t n = std::min(p.replay_samples ? p.replay_samples : train_d->count(), old_d->count());
+        out << "=== Replaying " << n << " of " << old_d->count() << " samples of " << p.replay_file << std::endl;
+        DataSet* mixed = new DataSet();
+        DataSourcePtr mixed_d(mixed);
+        mixed->add_samples(*train_d);
+        mixed->add_samples(*old_d, n);
+        mixed->shuffle();
+        mixed->normalize_all();
+        train_d = mixed_d;
+    }
+    const SampleSource& train = *train_d;
+    const SampleSource& xval = (xval_d && xval_d->count() ? *xval_d : train);
+    const SampleSource& test = (test_d && test_d->count() ? *test_d : xval);
+    Projection pr;
+    bool projected = load_projection(p.files[0], pr, out);
+    if (warm && (init.neural_net().no_inputs() != train.input_size() || init.neural_net().no_outputs() != train.output_size()))
+        throw std::runtime_error("Input or output size of " + p.init_file + " does not match the training data.");
+    if (warm) out << "=== Starting from " << p.init_file << " (" << train.count() << " training samples)" << std::endl;
+
+    std::vector<Real> rates = parse_list<Real>(p.rate_list);
+    Real rate = (rates.empty() ? (warm ? .1 : .5) : rates[0]);
 
     Classifier best_one;
     Real best_err = -1.0;
+    std::vector<string> candidates;
+    std::vector<Real> errors;
 
     for (size_t i = 0; i < p.try_count; ++i) {
-        std::cout << "--- Classifier #" << (i + 1) << std::endl;
-        NeuralNet nn(train.sample(0).first.size(), p.hidden_neurons, train.sample(0).second.size(), sigmoid_func, logsigmoid_func);
+        out << "--- Classifier #" << (i + 1) << std::endl;
+        // the network of a warm start is adapted to the normalization of the training data
+        NeuralNet nn = (warm ? init.renormalized(train.mean(), train.stddev())
+                             : NeuralNet(train.input_size(), p.hidden_neurons, train.output_size(), sigmoid_func, logsigmoid_func));
         Classifier c;
-        Classifier::Teacher t(c, nn, p.labels, train, test, xval);
-        if (!t.teach(p.chunk_size, .5)) continue;
+        Classifier::Teacher t(c, nn, p.labels, train, test, xval, !warm);
+        t.set_xval_sample(p.xval_sample);
+        t.set_cluster(cluster.get());
+        if (batch) t.set_batch(method, p.threads);
+        bool converged = t.teach(p.chunk_size, rate);
+        if (batch) out << "Full-batch passes: " << t.batch_passes() << ", iterations: " << t.iterations() << std::endl;
+        if (p.xval_sample)
+            out << "Crossvalidation: " << t.xval_estimates() << " estimates, "
+                << t.xval_evaluations() << " full evaluations" << std::endl;
+        if (!converged || worker) continue;
 
         Real err = c.error(test);
+        if (projected) c.prepend(pr);
         if (best_err < 0.0 || best_err > err) {
             best_err = err;
             best_one = c;
         }
-        std::ofstream ofs((p.out_file + "." + boost::lexical_cast<string>(i+1)).c_str());
+        string name = p.out_file + "." + boost::lexical_cast<string>(i+1);
+        std::ofstream ofs(name.c_str());
         ofs << c;
+        candidates.push_back(boost::filesystem::path(name).filename().string());
+        errors.push_back(err);
     }
 
+    // workers leave quietly, rank 0 writes the networks and reports
+    if (worker) std::exit(0);
+
+    // all candidates may be used together as an ensemble
+    if (candidates.size() > 1) Classifier::write_ensemble(p.out_file + ".ensemble", candidates, errors);
+
     std::cout << "=== Writing neural net" << std::endl;
     std::ofstream ofs(p.out_file.c_str());
     ofs << best_one;
 }
 
+/// hyperparameter search
+void tune(params& p)
+{
+    if (p.out_file.empty())    throw std::runtime_error("Specify classifier output filename.");
+    if (p.files.size() < 1)    throw std::runtime_error("Specify training, testing and crossvalidation data file.");
+    if (p.labels.size() == 0)  throw std::runtime_error("Specify output labels.");
+
+    std::vector<size_t> hidden = parse_list<size_t>(p.hidden_list), chunks = parse_list<size_t>(p.chunk_list);
+    std::vector<Real> rates = parse_list<Real>(p.rate_list);
+    if (hidden.empty() && p.hidden_neurons) hidden.push_back(p.hidden_neurons);
+    if (hidden.empty()) throw std::runtime_error("Specify numbers of hidden layer neurons.");
+    if (chunks.empty()) chunks.push_back(p.chunk_size);
+    if (rates.empty()) rates.push_back(.5);
+
+    Tuner::ConfigList configs = Tuner::grid(hidden, chunks, rates);
+    if (p.tune_budget && p.tune_budget < configs.size()) {
+        std::random_shuffle(configs.begin(), configs.end());
+        configs.resize(p.tune_budget);
+    }
+
+    std::cout << "=== Loading data" << std::endl;
+    DataSourcePtr train_d = open_data(p.files[0]), test_d, xval_d;
+    if (p.files.size() >= 2) test_d = open_data(p.files[1]);
+    if (p.files.size() >= 3) xval_d = open_data(p.files[2]);
+    const SampleSource& train = *train_d;
+    const SampleSource& xval = (xval_d && xval_d->count() ? *xval_d : train);
+    const SampleSource& test = (test_d && test_d->count() ? *test_d : xval);
+
+    std::cout << "=== Tuning " << configs.size() << " configurations on " << p.threads << " threads" << std::endl;
+    Tuner::Options opt;
+    opt.threads = p.threads;
+    opt.xval_sample = p.xval_sample;
+    Tuner tuner(configs, p.labels, train, test, xval, opt);
+    tuner.run(std::cout);
+    tuner.write_table(std::cout);
+
+    size_t best = tuner.best();
+    Classifier c = tuner.classifier(best);
+    Projection pr;
+    if (load_projection(p.files[0], pr, std::cout)) c.prepend(pr);
+    std::cout << "=== Writing neural net of configuration #" << (best + 1) << std::endl;
+    std::ofstream ofs(p.out_file.c_str());
+    ofs << c;
+}
+
+/// load the classifier, an ensemble if several files are given
+void load_classifier(params& p, Classifier& c)
+{
+    if (p.cls_files.empty()) throw std::runtime_error("Specify classifier filename.");
+    if (p.cls_files.size() > 1) c.load_ensemble(p.cls_files, std::vector<Real>(), InferencePlan::MEAN, p.verify);
+    else c.load_file(p.cls_files[0], true, p.verify);
+    if (!p.combination.empty()) c.set_combination(InferencePlan::parse_combination(p.combination));
+}
+
 /// classification
 void classify(params& p)
 {
-    if (p.cls_file.empty())    throw std::runtime_error("Specify classifier filename.");
     if (p.files.size() == 0)   throw std::runtime_error("Nothing to classify");
 
     static const int barsize = 40;
 
     Classifier c;
-    { std::ifstream ifs(p.cls_file.c_str()); ifs >> c; }
+    load_classifier(p, c);
 
     for (size_t i = 0; i < p.files.size(); ++i) {
 
         std::cout << "=== " << p.files[i] << std::endl;
         DataSet data;
-        data.load(p.files[i]);
+        data.load(p.files[i], LabelList(), p.selection);
+        if (data.silent())
+            std::cout << "--- " << data.silent() << " of " << (data.count() + data.dropped()) << " frames skipped as silent" << std::endl;
 
         Classifier::Vector result = c.exec(data);
         std::cout << "--- " << result << std::endl;
@@ -144,6 +565,371 @@ void classify(params& p)
     }
 }
 
+/// frame selection levels to compare in the reduction evaluation
+std::vector<FrameSelection> reduction_levels(const params& p, size_t avg_frames)
+{
+    std::vector<FrameSelection> levels(1);
+    if (p.selection.active()) {
+        levels.push_back(p.selection);
+        return levels;
+    }
+
+    static const size_t strides[] = { 2, 3, 4, 6 };
+    static const Real distances[] = { 0.5, 1.0 };
+    static const size_t fractions[] = { 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(strides) / sizeof(*strides); ++i) {
+        levels.push_back(FrameSelection());
+        levels.back().stride = strides[i];
+    }
+    for (size_t i = 0; i < sizeof(distances) / sizeof(*distances); ++i) {
+        levels.push_back(FrameSelection());
+        levels.back().min_distance = distances[i];
+    }
+    for (size_t i = 0; i < sizeof(fractions) / sizeof(*fractions); ++i) {
+        levels.push_back(FrameSelection());
+        levels.back().budget = std::max<size_t>(avg_frames / fractions[i], 1);
+    }
+    return levels;
+}
+
+/// frame accuracy, error and speed of a classifier
+struct FrameScore {
+    Real accuracy;     ///< fraction of frames with the desired best label
+    Real error;        ///< squared error
+    Real us_per_frame; ///< inference time
+};
+
+/// score a classifier on raw (unnormalized) frames and their desired outputs
+FrameScore score_frames(const Classifier& c, const std::vector<Classifier::Vector>& in, const std::vector<Classifier::Vector>& out)
+{
+    const double min_time = 0.5; // repeat passes for stable timing
+    FrameScore s = { 0.0, 0.0, 0.0 };
+    size_t correct = 0, passes = 0;
+    double start = wall_time(), elapsed;
+    do {
+        for (size_t i = 0; i < in.size(); ++i) {
+            Classifier::Vector r = c.exec(in[i]);
+            if (passes) continue;
+            Classifier::Vector d = out[i] - r;
+            s.error += inner_prod(d, d);
+            if (std::max_element(r.begin(), r.end()) - r.begin() == std::max_element(out[i].begin(), out[i].end()) - out[i].begin())
+                ++correct;
+        }
+        ++passes;
+    } while ((elapsed = wall_time() - start) < min_time);
+    s.accuracy = in.empty() ? 0.0 : Real(correct) / in.size();
+    s.us_per_frame = in.empty() ? 0.0 : 1e6 * elapsed / (passes * in.size());
+    return s;
+}
+
+/// up to @a max_frames unnormalized frames of normalized data and their desired outputs
+void raw_frames(const SampleSource& data, size_t max_frames, std::vector<Classifier::Vector>& in, std::vector<Classifier::Vector>& out)
+{
+    // the data are normalized by their own statistics
+    Classifier::Vector m = data.mean(), s = data.stddev();
+    SampleSource::DataSampleList buf;
+    for (size_t b = 0; b < data.blocks() && in.size() < max_frames; ++b) {
+        const SampleSource::DataSampleList& blk = data.block(b, buf);
+        for (size_t i = 0; i < blk.size() && in.size() < max_frames; ++i) {
+            in.push_back(element_prod(blk[i].first, s) + m);
+            out.push_back(blk[i].second);
+        }
+    }
+}
+
+/// prune a network and report the effect
+void prune(params& p)
+{
+    const size_t max_frames = 20000;
+    if (p.cls_file.empty())  throw std::runtime_error("Specify classifier filename.");
+    if (p.out_file.empty())  throw std::runtime_error("Specify output filename.");
+    if (p.files.empty())     throw std::runtime_error("Specify data to evaluate the pruned network on.");
+    if (p.prune_fraction <= 0.0 || p.prune_fraction >= 1.0) throw std::runtime_error("Specify fraction of weights to prune (0 < fraction < 1).");
+
+    Classifier original;
+    original.load_file(p.cls_file, false, p.verify);
+
+    std::cout << "=== Loading data" << std::endl;
+    DataSourcePtr train_d = open_data(p.files[0]), test_d, xval_d;
+    if (p.files.size() >= 2) test_d = open_data(p.files[1]);
+    if (p.files.size() >= 3) xval_d = open_data(p.files[2]);
+    const SampleSource& train = *train_d;
+    const SampleSource& xval = (xval_d && xval_d->count() ? *xval_d : train);
+    const SampleSource& test = (test_d && test_d->count() ? *test_d : xval);
+    const SampleSource& eval = (xval_d ? *xval_d : test_d ? *test_d : train);
+
+    std::cout << "=== Pruning " << 100.0 * p.prune_fraction << "% of weights by " << (p.sensitivity ? "sensitivity" : "magnitude") << std::endl;
+    Classifier c(original);
+    c.prune(p.prune_fraction, p.sensitivity ? &train : 0);
+    if (p.fine_tune) {
+        std::vector<Real> rates = parse_list<Real>(p.rate_list);
+        std::cout << "=== Fine-tuning" << std::endl;
+        NeuralNet pruned = c.renormalized(train.mean(), train.stddev());
+        LabelList labels = c.labels();
+        Classifier::Teacher t(c, pruned, labels, train, test, xval, false, true);
+        t.set_xval_sample(p.xval_sample);
+        if (!p.batch_method.empty()) t.set_batch(BatchOptimizer::parse_method(p.batch_method), p.threads);
+        t.teach(p.chunk_size, rates.empty() ? .1 : rates[0]);
+    }
+
+    if (p.binary) c.save_binary(p.out_file);
+    else {
+        std::ofstream ofs(p.out_file.c_str());
+        if (!(ofs << c)) throw std::runtime_error("Unable to write " + p.out_file);
+    }
+
+    std::vector<Classifier::Vector> in, out;
+    raw_frames(eval, max_frames, in, out);
+
+    const NeuralNet::LayerArray& layers = c.neural_net().get_layers();
+    std::cout << "=== Pruning report (" << in.size() << " frames)" << std::endl;
+    for (size_t l = 0; l < layers.size(); ++l)
+        std::cout << "--- layer " << (l + 1) << ": " << layers[l].no_inputs() << "x" << layers[l].no_outputs() << ", "
+                  << 100.0 * layers[l].zeros() / (layers[l].no_inputs() * layers[l].no_outputs()) << "% zero" << std::endl;
+    std::cout << "--- sparsity " << 100.0 * c.neural_net().sparsity() << "%, " << c.sparse_layers()
+              << " layers evaluated as sparse" << std::endl;
+
+    FrameScore before = score_frames(original, in, out), after = score_frames(c, in, out);
+    std::cout << "--- original: frame accuracy " << 100.0 * before.accuracy << "%, error " << before.error
+              << ", " << before.us_per_frame << " us/frame" << std::endl
+              << "--- pruned:   frame accuracy " << 100.0 * after.accuracy << "% (" << std::showpos
+              << 100.0 * (after.accuracy - before.accuracy) << std::noshowpos << "), error " << after.error
+              << ", " << after.us_per_frame << " us/frame (speedup " << before.us_per_frame / after.us_per_frame << "x)" << std::endl;
+}
+
+/// train a small network on the outputs of a larger one or an ensemble
+void distill(params& p)
+{
+    const size_t max_frames = 20000;
+    if (p.hidden_neurons == 0) throw std::runtime_error("Specify number of hidden layser neurons.");
+    if (p.out_file.empty())    throw std::runtime_error("Specify classifier output filename.");
+    if (p.files.size() < 1)    throw std::runtime_error("Specify training, testing and crossvalidation data file.");
+
+    Classifier teacher;
+    load_classifier(p, teacher);
+
+    std::cout << "=== Loading data" << std::endl;
+    DataSourcePtr train_d = open_data(p.files[0]), test_d, xval_d;
+    if (p.files.size() >= 2) test_d = open_data(p.files[1]);
+    if (p.files.size() >= 3) xval_d = open_data(p.files[2]);
+    const SampleSource& train = *train_d;
+    const SampleSource& xval = (xval_d && xval_d->count() ? *xval_d : train);
+    const SampleSource& test = (test_d && test_d->count() ? *test_d : xval);
+    const SampleSource& eval = (xval_d ? *xval_d : test_d ? *test_d : train);
+    if (teacher.labels().size() != train.output_size()) throw std::runtime_error("Labels of the teacher do not match the data.");
+
+    // the teacher is evaluated once, the student is presented its outputs in every pass
+    std::cout << "=== Computing soft targets of " << teacher.members() << " network(s)" << std::endl;
+    DataSet soft;
+    teacher.soft_targets(train, soft);
+    soft.normalize_all();
+
+    std::cout << "=== Training student" << std::endl;
+    std::vector<Real> rates = parse_list<Real>(p.rate_list);
+    NeuralNet nn(soft.input_size(), p.hidden_neurons, soft.output_size(), sigmoid_func, logsigmoid_func);
+    Classifier student;
+    Classifier::Teacher t(student, nn, teacher.labels(), soft, test, xval);
+    t.set_xval_sample(p.xval_sample);
+    if (!t.teach(p.chunk_size, rates.empty() ? .5 : rates[0])) throw std::runtime_error("Student training failed.");
+
+    if (p.binary) student.save_binary(p.out_file);
+    else {
+        std::ofstream ofs(p.out_file.c_str());
+        if (!(ofs << student)) throw std::runtime_error("Unable to write " + p.out_file);
+    }
+
+    std::vector<Classifier::Vector> in, out;
+    raw_frames(eval, max_frames, in, out);
+    FrameScore before = score_frames(teacher, in, out), after = score_frames(student, in, out);
+    std::cout << "=== Distillation report (" << in.size() << " frames)" << std::endl
+              << "--- teacher: frame accuracy " << 100.0 * before.accuracy << "%, error " << before.error
+              << ", " << before.us_per_frame << " us/frame" << std::endl
+              << "--- student: frame accuracy " << 100.0 * after.accuracy << "% (" << std::showpos
+              << 100.0 * (after.accuracy - before.accuracy) << std::noshowpos << "), error " << after.error
+              << ", " << after.us_per_frame << " us/frame (speedup " << before.us_per_frame / after.us_per_frame << "x)" << std::endl;
+}
+
+/// evaluate the effect of frame selection on training time and crossvalidation error
+void reduction(params& p)
+{
+    if (p.labels.size() == 0)  throw std::runtime_error("Specify desired labels.");
+    if (p.data_dir.empty())    throw std::runtime_error("Specify data directory.");
+    if (p.hidden_neurons == 0) throw std::runtime_error("Specify number of hidden layser neurons.");
+
+    std::vector<string> files = list_records(p.data_dir);
+
+    // all frames are extracted once, levels only select from them
+    std::cout << "=== Loading data & extracting features" << std::endl;
+    std::vector<DataSet> records;
+    DataSet xval_raw;
+    size_t frames = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        DataSet d;
+        d.load(files[i], p.labels);
+        if (i % 5 == 4) xval_raw.append(d);
+        else { records.push_back(d); frames += d.count(); }
+    }
+    if (records.empty() || xval_raw.count() == 0) throw std::runtime_error("Not enough records for the evaluation.");
+
+    std::vector<FrameSelection> levels = reduction_levels(p, frames / records.size());
+    std::vector<string> rows;
+    for (size_t l = 0; l < levels.size(); ++l) {
+        std::cout << "--- " << levels[l].str() << std::endl;
+        DataSet train;
+        for (size_t r = 0; r < records.size(); ++r) {
+            std::vector<FeatureVector> fr(records[r].count());
+            for (size_t i = 0; i < fr.size(); ++i) fr[i] = records[r].sample(i).first;
+            std::vector<size_t> keep = levels[l].select(fr);
+            for (size_t i = 0; i < keep.size(); ++i) train.add_sample(fr[keep[i]], records[r].sample(keep[i]).second);
+        }
+        train.shuffle();
+        train.normalize_all();
+        DataSet xval = xval_raw;
+        xval.normalize_all(train.mean(), train.stddev());
+
+        double t = wall_time();
+        NeuralNet nn(train.input_size(), p.hidden_neurons, train.output_size(), sigmoid_func, logsigmoid_func);
+        Classifier c;
+        Classifier::Teacher teacher(c, nn, p.labels, train, xval, xval);
+        bool converged = teacher.teach(p.chunk_size, .5);
+        t = wall_time() - t;
+
+        Real err = c.error(xval);
+        std::ostringstream os;
+        os << std::setw(36) << std::left << levels[l].str() << std::right
+           << std::setw(9) << train.count() << std::setw(8) << std::setprecision(3) << double(train.count()) / frames
+           << std::setw(10) << std::setprecision(4) << t << std::setw(12) << std::setprecision(6) << err / xval.count()
+           << (converged ? "" : "  (not converged)");
+        rows.push_back(os.str());
+    }
+
+    std::cout << "=== Frame reduction (" << records.size() << " training records, " << frames << " frames, "
+              << xval_raw.count() << " crossvalidation frames)" << std::endl;
+    std::cout << std::setw(36) << std::left << "selection" << std::right << std::setw(9) << "frames" << std::setw(8) << "ratio"
+              << std::setw(10) << "train[s]" << std::setw(12) << "xval err" << std::endl;
+    for (size_t i = 0; i < rows.size(); ++i) std::cout << rows[i] << std::endl;
+}
+
+/// classification accuracy on an annotated directory
+void evaluate(params& p)
+{
+    if (p.data_dir.empty()) throw std::runtime_error("Specify data directory.");
+
+    Classifier c;
+    load_classifier(p, c);
+
+    std::vector<string> files = list_records(p.data_dir);
+    for (size_t i = 0; i < files.size(); ++i) files[i] += ".wav";
+
+    Evaluation eval(c.labels(), p.top_k);
+    p.pipeline.selection = p.selection;
+    ClassifyPipeline pipeline(c, p.pipeline);
+    const ClassifyPipeline::Stats& s = pipeline.run(files, eval);
+
+    eval.write_text(std::cout, s);
+    if (!p.out_file.empty()) {
+        std::ofstream ofs(p.out_file.c_str());
+        eval.write_json(ofs, s);
+        if (!ofs) throw std::runtime_error("Unable to write " + p.out_file);
+    }
+}
+
+/// classification timeline of sliding windows
+void segments(params& p)
+{
+    if (p.files.size() == 0) throw std::runtime_error("Nothing to classify");
+
+    Classifier c;
+    load_classifier(p, c);
+
+    std::ofstream outfile(p.out_file.c_str());
+    std::ostream& os = (!p.out_file.empty() ? outfile : std::cout);
+
+    const Real period = Features::frame_period();
+    size_t window = std::max<size_t>(static_cast<size_t>(p.window / period + .5), 1);
+    size_t hop = std::max<size_t>(static_cast<size_t>(p.hop / period + .5), 1);
+
+    os << "file\tstart\tend\tlabel";
+    for (size_t l = 0; l < c.labels().size(); ++l) os << '\t' << c.labels()[l];
+    os << std::endl;
+
+    for (size_t i = 0; i < p.files.size(); ++i) {
+        DataSet data;
+        data.load(p.files[i]);
+        std::vector<Classifier::Vector> res = c.exec(data, window, hop);
+        size_t len = std::min(window, data.count());
+        for (size_t w = 0; w < res.size(); ++w) {
+            size_t best = std::max_element(res[w].begin(), res[w].end()) - res[w].begin();
+            os << p.files[i] << '\t' << w * hop * period << '\t' << (w * hop + len) * period
+               << '\t' << (best < c.labels().size() ? c.labels()[best] : string("?"));
+            for (size_t l = 0; l < res[w].size(); ++l) os << '\t' << res[w](l);
+            os << '\n';
+        }
+    }
+    os.flush();
+}
+
+/// pipelined classification of many files
+void batch(params& p)
+{
+
+    // file names are read from the standard input if none are given
+    if (p.files.empty()) {
+        string line;
+        while (getline(std::cin, line)) if (!line.empty()) p.files.push_back(line);
+    }
+
+    Classifier c;
+    load_classifier(p, c);
+
+    std::ofstream outfile(p.out_file.c_str());
+    std::ostream& os = (!p.out_file.empty() ? outfile : std::cout);
+
+    p.pipeline.selection = p.selection;
+    ClassifyPipeline pipeline(c, p.pipeline);
+    const ClassifyPipeline::Stats& s = pipeline.run(p.files, os, std::cerr);
+
+    if (p.verbose || !p.out_file.empty()) {
+        std::cerr << "=== " << s.files << " files (" << s.failed << " failed), " << s.frames << " frames";
+        if (s.silent) std::cerr << " (" << s.silent << " silent skipped)";
+        std::cerr << " in "
+                  << s.wall_time << " s, " << s.files / std::max(s.wall_time, 1e-9) << " files/s" << std::endl
+                  << "--- threads " << p.pipeline.readers << ':' << p.pipeline.extractors << ':' << p.pipeline.inference
+                  << ", busy: read " << s.read_time << " s, extract " << s.extract_time << " s, infer " << s.infer_time << " s"
+                  << ", full queue waits: " << s.read_waits << '/' << s.extract_waits << '/' << s.infer_waits << std::endl;
+    }
+}
+
+/// classification daemon
+void serve(params& p)
+{
+    if (p.out_file.empty()) throw std::runtime_error("Specify socket filename.");
+
+    Classifier c;
+    load_classifier(p, c);
+
+    ClassifierServer server(c, p.out_file, p.threads);
+    std::cout << "=== Listening on " << p.out_file << " (" << p.threads << " workers)" << std::endl;
+    server.run();
+    std::cout << "=== Served " << server.requests() << " requests" << std::endl;
+}
+
+/// convert a classifier between the text and binary model formats
+void convert(params& p)
+{
+    if (p.cls_file.empty()) throw std::runtime_error("Specify classifier filename.");
+    if (p.out_file.empty()) throw std::runtime_error("Specify output filename.");
+
+    Classifier c;
+    c.load_file(p.cls_file, false, p.verify);
+    if (ModelFile::is_model(p.cls_file)) {
+        std::ofstream ofs(p.out_file.c_str());
+        if (!(ofs << c)) throw std::runtime_error("Unable to write " + p.out_file);
+    } else {
+        c.save_binary(p.out_file);
+    }
+}
+
 /// show features extracted from a file
 void show_features(params& p)
 {
@@ -161,6 +947,43 @@ void show_features(params& p)
     }
 }
 
+/// generate a synthetic corpus and/or dataset
+void synth(params& p)
+{
+    if (p.labels.size() == 0)  throw std::runtime_error("Specify desired labels.");
+    if (p.data_dir.empty() && p.out_file.empty()) throw std::runtime_error("Specify corpus directory or output filename.");
+
+    Synthesizer::Options o;
+    o.labels = p.labels;
+    if (p.records) o.records = p.records;
+    o.length = p.window;
+    o.dims = p.dims;
+    o.separation = p.separation;
+    unsigned seed = (p.seeded ? p.seed : 1);
+
+    if (!p.data_dir.empty()) {
+        std::cout << "=== Writing " << o.records << " records to " << p.data_dir << std::endl;
+        Synthesizer(o, seed).corpus(p.data_dir);
+    }
+    if (p.out_file.empty()) return;
+
+    std::cout << "=== Writing dataset " << p.out_file << std::endl;
+    Synthesizer s(o, seed);
+    if (p.binary) {
+        DataStream::Writer out(p.out_file, false, p.encoding);
+        s.dataset(out);
+        out.close();
+        std::cout << "=== DONE (" << out.count() << " samples)" << std::endl;
+        return;
+    }
+    DataSet data;
+    s.dataset(data);
+    data.normalize_all();
+    data.shuffle();
+    data.write_tmp(p.out_file);
+    std::cout << "=== DONE (" << data.count() << " samples)" << std::endl;
+}
+
 void foo(params& p)
 {
     Classifier c;
@@ -196,9 +1019,30 @@ void parse_params(int argc, char** argv, params& p)
 {
     p.prog = argv[0];
     p.verbose = false;
+    p.binary = false;
+    p.encoding = DataStream::REAL;
     p.hidden_neurons = 0;
     p.chunk_size = 20;
     p.try_count = 1;
+    p.xval_sample = 0;
+    p.prune_fraction = 0.0;
+    p.sensitivity = false;
+    p.fine_tune = false;
+    p.threads = 1;
+    p.workers = 1;
+    p.projection = 0;
+    p.whiten = false;
+    p.top_k = 2;
+    p.window = 5.0;
+    p.hop = 1.0;
+    p.records = 0;
+    p.tune_budget = 0;
+    p.replay_samples = 0;
+    p.dims = 30;
+    p.separation = 4.0;
+    p.seed = 0;
+    p.seeded = false;
+    p.verify = false;
 
     if (argc < 2) throw std::runtime_error("Mode needs to be specified, try: " + p.prog + " help");
 
@@ -206,20 +1050,71 @@ void parse_params(int argc, char** argv, params& p)
          if (str == "help")     p.mode = prog_help;
     else if (str == "foo")      p.mode = foo;
     else if (str == "dataset")  p.mode = do_dataset;
+    else if (str == "append")   p.mode = do_append;
+    else if (str == "project")  p.mode = project;
     else if (str == "train")    p.mode = training;
+    else if (str == "tune")     p.mode = tune;
+    else if (str == "prune")    p.mode = prune;
+    else if (str == "distill")  p.mode = distill;
     else if (str == "classify") p.mode = classify;
     else if (str == "features") p.mode = show_features;
+    else if (str == "reduction") p.mode = reduction;
+    else if (str == "convert")  p.mode = convert;
+    else if (str == "serve")    p.mode = serve;
+    else if (str == "batch")    p.mode = batch;
+    else if (str == "segments") p.mode = segments;
+    else if (str == "evaluate") p.mode = evaluate;
+    else if (str == "synth")    p.mode = synth;
     else throw std::runtime_error("Unknown mode: " + str);
 
     for (int i = 2; i < argc; ++i) {
         str = argv[i];
              if (str == "-v") p.verbose = true;
+        else if (str == "-b") p.binary = true;
+        else if (str == "-F") p.fine_tune = true;
+        else if (str == "-P") p.prune_fraction = boost::lexical_cast<Real>(argv[++i]);
+        else if (str == "-M") {
+            string crit = argv[++i];
+            if (crit != "magnitude" && crit != "sensitivity") throw std::runtime_error("Unknown pruning criterion: " + crit);
+            p.sensitivity = (crit == "sensitivity");
+        }
+        else if (str == "-e") p.encoding = DataStream::parse_encoding(argv[++i]);
+        else if (str == "-T") p.trace_file = argv[++i];
+        else if (str == "--init")   p.init_file = argv[++i];
+        else if (str == "--replay") p.replay_file = argv[++i];
+        else if (str == "--replay-samples") p.replay_samples = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "--pca" || str == "--whiten") {
+            p.projection = boost::lexical_cast<size_t>(argv[++i]);
+            p.whiten = (str == "--whiten");
+        }
+        else if (str == "--seed") { p.seed = boost::lexical_cast<unsigned>(argv[++i]); p.seeded = true; }
+        else if (str == "--verify") p.verify = true;
+        else if (str == "--budget") p.tune_budget = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-H") p.hidden_list = argv[++i];
+        else if (str == "-C") p.chunk_list  = argv[++i];
+        else if (str == "-R") p.rate_list   = argv[++i];
+        else if (str == "-N") p.records    = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-D") p.dims       = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-S") p.separation = boost::lexical_cast<Real>(argv[++i]);
         else if (str == "-o") p.out_file = argv[++i];
-        else if (str == "-f") p.cls_file = argv[++i];
+        else if (str == "-f") p.cls_files.push_back(p.cls_file = argv[++i]);
+        else if (str == "-E") p.combination = argv[++i];
         else if (str == "-d") p.data_dir = argv[++i];
         else if (str == "-t") p.try_count      = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-x") p.xval_sample    = boost::lexical_cast<size_t>(argv[++i]);
         else if (str == "-h") p.hidden_neurons = boost::lexical_cast<size_t>(argv[++i]);
         else if (str == "-c") p.chunk_size     = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-j") p.threads        = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-W") p.workers        = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-B") p.batch_method   = argv[++i];
+        else if (str == "-s") p.selection.stride       = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-m") p.selection.min_distance = boost::lexical_cast<Real>(argv[++i]);
+        else if (str == "-n") p.selection.budget       = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-g") p.selection.gate         = boost::lexical_cast<Real>(argv[++i]);
+        else if (str == "-K") p.top_k  = boost::lexical_cast<size_t>(argv[++i]);
+        else if (str == "-w") p.window = boost::lexical_cast<Real>(argv[++i]);
+        else if (str == "-k") p.hop    = boost::lexical_cast<Real>(argv[++i]);
+        else if (str == "-p") p.pipeline = ClassifyPipeline::Options::parse(argv[++i]);
         else if (str == "-l") boost::algorithm::split(p.labels, argv[++i], boost::algorithm::is_any_of(":"));
         else if (str.substr(0, 1) == "-") throw std::runtime_error("Unrecognized commandline option: " + str);
         else p.files.push_back(str);
@@ -232,7 +1127,14 @@ int main(int argc, char** argv)
     try {
         params p;
         parse_params(argc, argv, p);
+        if (p.verbose || !p.trace_file.empty()) Profile::enable(!p.trace_file.empty());
+        if (p.seeded) {
+            NNLayer::seed(p.seed);
+            std::srand(p.seed);
+        }
         p.mode(p);
+        if (p.verbose) Profile::report(std::cerr);
+        if (!p.trace_file.empty()) Profile::write_trace(p.trace_file);
     } catch (std::runtime_error& e) {
         std::cout << "ERROR: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,116 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "manifest.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+const char MANIFEST_SUFFIX[] = ".manifest";
+
+/// record key (file name without directory and extension)
+static std::string record_key(const std::string& filename_base)
+{
+    return boost::filesystem::path(filename_base).filename().string();
+}
+
+/// add file contents to a checksum
+static void checksum_file(boost::crc_32_type& crc, const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs) throw std::runtime_error("Unable to read " + filename);
+    char buf[65536];
+    while (ifs.read(buf, sizeof(buf)) || ifs.gcount())
+        crc.process_bytes(buf, ifs.gcount());
+}
+
+DataManifest::DataManifest(const LabelList& l) : labels_(l) {}
+
+std::string DataManifest::filename_for(const std::string& dataset) { return dataset + MANIFEST_SUFFIX; }
+
+DataManifest::Entry DataManifest::describe(const std::string& filename_base, bool with_hash)
+{
+    Entry e;
+    std::string wav = filename_base + ".wav";
+    e.size = boost::filesystem::file_size(wav);
+    e.mtime = boost::filesystem::last_write_time(wav);
+    std::string tag = filename_base + ".tag";
+    bool tagged = boost::filesystem::exists(tag);
+    e.tag_size = (tagged ? boost::filesystem::file_size(tag) : 0);
+    e.tag_mtime = (tagged ? boost::filesystem::last_write_time(tag) : 0);
+    e.frames = 0;
+    e.hash = 0;
+    if (with_hash) {
+        boost::crc_32_type crc;
+        checksum_file(crc, wav);
+        if (tagged) checksum_file(crc, tag);
+        e.hash = crc.checksum();
+    }
+    return e;
+}
+
+DataManifest::Status DataManifest::check(const std::string& filename_base, Entry& e) const
+{
+    EntryMap::const_iterator it = entries_.find(record_key(filename_base));
+    if (it == entries_.end()) {
+        e = describe(filename_base);
+        return NEW;
+    }
+
+    // contents are only checksummed again when either file looks different
+    e = describe(filename_base, false);
+    const Entry& old = it->second;
+    if (e.size != old.size || e.mtime != old.mtime || e.tag_size != old.tag_size || e.tag_mtime != old.tag_mtime) {
+        e = describe(filename_base);
+        if (e.hash != old.hash) return CHANGED;
+    }
+    e.hash = old.hash;
+    e.frames = old.frames;
+    return UNCHANGED;
+}
+
+void DataManifest::add(const std::string& filename_base, const Entry& e) { entries_[record_key(filename_base)] = e; }
+
+void DataManifest::load(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str());
+    if (!ifs) throw std::runtime_error("Unable to open manifest " + filename);
+
+    std::string line, key;
+    if (!getline(ifs, line) || line.compare(0, 7, "labels ") != 0)
+        throw std::runtime_error("Malformed manifest " + filename);
+    std::string labels = line.substr(7);
+    boost::algorithm::split(labels_, labels, boost::algorithm::is_any_of(":"));
+
+    entries_.clear();
+    while (getline(ifs, line)) {
+        if (line.empty()) continue;
+        std::istringstream is(line);
+        Entry e;
+        is >> std::hex >> e.hash >> std::dec >> e.size >> e.mtime >> e.tag_size >> e.tag_mtime >> e.frames;
+        if (!is || !getline(is >> std::ws, key)) throw std::runtime_error("Malformed manifest " + filename);
+        entries_[key] = e;
+    }
+}
+
+void DataManifest::save(const std::string& filename) const
+{
+    std::ofstream ofs(filename.c_str());
+    if (!ofs) throw std::runtime_error("Unable to write manifest " + filename);
+    ofs << "labels " << boost::algorithm::join(labels_, ":") << std::endl;
+    for (EntryMap::const_iterator i = entries_.begin(); i != entries_.end(); ++i)
+        ofs << std::hex << std::setw(8) << std::setfill('0') << i->second.hash << std::dec << std::setfill(' ')
+            << ' ' << i->second.size << ' ' << i->second.mtime << ' ' << i->second.tag_size << ' ' << i->second.tag_mtime
+            << ' ' << i->second.frames << ' ' << i->first << std::endl;
+}
@@ -0,0 +1,74 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef MANIFEST_HPP_
+#define MANIFEST_HPP_
+
+#include "common.hpp"
+#include <map>
+#include <string>
+#include <ctime>
+#include <boost/cstdint.hpp>
+
+/**
+ * List of source records a dataset was built from.
+ * Stored next to the dataset (<dataset>.manifest), it allows adding
+ * only new records to an existing dataset.
+ */
+class DataManifest {
+    public:
+        /// record entry
+        struct Entry {
+            boost::uint32_t hash; ///< checksum of the .wav and .tag contents
+            boost::uintmax_t size; ///< .wav file size
+            std::time_t mtime;    ///< .wav modification time
+            boost::uintmax_t tag_size; ///< .tag file size (zero without a .tag file)
+            std::time_t tag_mtime; ///< .tag modification time (zero without a .tag file)
+            size_t frames;        ///< number of samples extracted
+        };
+        /// entries by record name (file name without extension)
+        typedef std::map<std::string, Entry> EntryMap;
+
+        /// record state with respect to the manifest
+        enum Status { NEW, UNCHANGED, CHANGED };
+
+    public:
+        /// empty manifest
+        explicit DataManifest(const LabelList& labels = LabelList());
+
+        /// load manifest file
+        void load(const std::string& filename);
+        /// write manifest file
+        void save(const std::string& filename) const;
+
+        /**
+         * check a record against the manifest
+         * @param filename_base record path without extension
+         * @param e filled with current record entry (frames are known for unchanged records only)
+         */
+        Status check(const std::string& filename_base, Entry& e) const;
+        /// add or replace a record entry
+        void add(const std::string& filename_base, const Entry& e);
+
+        /// dataset labels
+        const LabelList& labels() const { return labels_; }
+        /// record entries
+        const EntryMap& entries() const { return entries_; }
+
+        /// manifest file name for a dataset file
+        static std::string filename_for(const std::string& dataset);
+        /// describe a record (size, time and content checksum of its files)
+        static Entry describe(const std::string& filename_base, bool with_hash = true);
+
+    private:
+        LabelList labels_;
+        EntryMap entries_;
+};
+
+#endif // MANIFEST_HPP_
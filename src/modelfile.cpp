@@ -0,0 +1,191 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "modelfile.hpp"
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <boost/crc.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+using namespace boost::interprocess;
+
+const char MODEL_MAGIC[8] = { 'S', 'F', 'C', 'M', 'O', 'D', 'L', '\n' };
+const boost::uint32_t MODEL_VERSION = 1;
+const size_t MODEL_ALIGN = 64;
+
+/// binary model file header
+struct ModelHeader {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t real_size;
+    boost::uint32_t n_labels;
+    boost::uint32_t n_layers;
+    boost::uint64_t in_size;
+    boost::uint64_t labels_offset;
+    boost::uint64_t labels_size;
+    boost::uint64_t norm_offset;
+    boost::uint64_t layers_offset;
+    boost::uint64_t file_size;
+    boost::uint32_t checksum;
+    boost::uint32_t reserved;
+};
+
+/// layer table entry
+struct ModelLayer {
+    boost::uint32_t activation;
+    boost::uint32_t reserved;
+    boost::uint64_t inputs;
+    boost::uint64_t outputs;
+    boost::uint64_t offset;
+};
+
+static size_t align(size_t pos) { return (pos + MODEL_ALIGN - 1) / MODEL_ALIGN * MODEL_ALIGN; }
+
+/// whether count items of item bytes at offset lie within size bytes (checked without overflowing)
+static bool fits(boost::uint64_t offset, boost::uint64_t count, boost::uint64_t item, boost::uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / item;
+}
+
+/// append raw data to a buffer at an aligned position, return the position
+static size_t put(std::vector<char>& buf, const void* data, size_t size)
+{
+    size_t pos = align(buf.size());
+    buf.resize(pos + size);
+    if (size) std::memcpy(&buf[pos], data, size);
+    return pos;
+}
+
+ModelFile::ModelFile(const std::string& filename, bool verify)
+{
+    try {
+        file_mapping(filename.c_str(), read_only).swap(file);
+        mapped_region(file, read_only).swap(region);
+    } catch (interprocess_exception& e) {
+        throw std::runtime_error("Unable to map model " + filename + ": " + e.what());
+    }
+
+    const char* base = static_cast<const char*>(region.get_address());
+    size_t size = region.get_size();
+    const ModelHeader& h = *reinterpret_cast<const ModelHeader*>(base);
+    if (size < sizeof(h) || std::memcmp(h.magic, MODEL_MAGIC, sizeof(h.magic)) != 0)
+        throw std::runtime_error("Not a model file: " + filename);
+    if (h.version != MODEL_VERSION || h.real_size != sizeof(Real))
+        throw std::runtime_error("Unsupported model version: " + filename);
+    if (h.file_size != size || h.n_layers == 0
+            || !fits(h.labels_offset, h.labels_size, 1, size)
+            || !fits(h.norm_offset, h.in_size, 2 * sizeof(Real), size)
+            || !fits(h.layers_offset, h.n_layers, sizeof(ModelLayer), size))
+        throw std::runtime_error("Truncated model file: " + filename);
+
+    // the checksum touches every page, which would defeat mapping the weights lazily
+    if (verify) {
+        boost::crc_32_type crc;
+        crc.process_bytes(base + align(sizeof(h)), size - align(sizeof(h)));
+        if (crc.checksum() != h.checksum) throw std::runtime_error("Model checksum mismatch: " + filename);
+    }
+
+    std::string labels(base + h.labels_offset, h.labels_size);
+    boost::algorithm::split(labels_, labels, boost::algorithm::is_any_of(";"));
+    labels_.resize(h.n_labels);
+
+    in_size = h.in_size;
+    mean_ = reinterpret_cast<const Real*>(base + h.norm_offset);
+    stddev_ = mean_ + in_size;
+
+    const ModelLayer* table = reinterpret_cast<const ModelLayer*>(base + h.layers_offset);
+    size_t inputs = in_size;
+    for (size_t i = 0; i < h.n_layers; ++i) {
+        const ModelLayer& ml = table[i];
+        Layer l;
+        l.inputs = ml.inputs;
+        l.outputs = ml.outputs;
+        l.weights = reinterpret_cast<const Real*>(base + ml.offset);
+        l.act = NNLayer::activation_by_id(ml.activation);
+        if (!l.act) throw std::runtime_error("Unknown activation function in model " + filename);
+        // inputs are bounded by the previous layer (or the normalization), so a row size does not overflow
+        if (l.inputs != inputs || ml.offset % sizeof(Real)
+                || !fits(ml.offset, l.outputs, (l.inputs + 1) * sizeof(Real), size))
+            throw std::runtime_error("Malformed model layer in " + filename);
+        inputs = l.outputs;
+        layers_.push_back(l);
+    }
+    if (h.n_labels != inputs) throw std::runtime_error("Number of labels does not match the outputs of model " + filename);
+}
+
+InferencePlan ModelFile::plan() const { return InferencePlan(layers_, mean_, stddev_); }
+
+NeuralNet ModelFile::network() const
+{
+    NeuralNet nn;
+    for (LayerList::const_iterator l = layers_.begin(); l != layers_.end(); ++l) {
+        NNLayer::Matrix w(l->inputs + 1, l->outputs);
+        std::copy(l->weights, l->weights + w.data().size(), w.data().begin());
+        NNLayer layer(w, *l->act);
+        nn.add_layer(layer);
+    }
+    return nn;
+}
+
+bool ModelFile::is_model(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    char magic[sizeof(MODEL_MAGIC)];
+    return ifs.read(magic, sizeof(magic)) && std::memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0;
+}
+
+void ModelFile::write(const std::string& filename, const LabelList& labels,
+                      const FeatureVector& mean, const FeatureVector& stddev, const NeuralNet& nn)
+{
+    const NeuralNet::LayerArray& layers = nn.get_layers();
+    if (layers.empty()) throw std::runtime_error("Empty neural network");
+    if (mean.size() != nn.no_inputs() || stddev.size() != nn.no_inputs())
+        throw std::runtime_error("Normalization does not match the neural network");
+
+    ModelHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MODEL_MAGIC, sizeof(h.magic));
+    h.version = MODEL_VERSION;
+    h.real_size = sizeof(Real);
+    h.n_labels = labels.size();
+    h.n_layers = layers.size();
+    h.in_size = mean.size();
+
+    std::vector<char> buf(sizeof(h));
+    std::string names = boost::algorithm::join(labels, ";");
+    h.labels_size = names.size();
+    h.labels_offset = put(buf, names.data(), names.size());
+    std::vector<Real> norm(mean.begin(), mean.end());
+    norm.insert(norm.end(), stddev.begin(), stddev.end());
+    h.norm_offset = put(buf, &norm[0], norm.size() * sizeof(Real));
+
+    std::vector<ModelLayer> table(layers.size());
+    h.layers_offset = put(buf, &table[0], table.size() * sizeof(ModelLayer));
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const NNLayer::Matrix& w = layers[i].weight_matrix();
+        table[i].activation = layers[i].activation().id();
+        table[i].reserved = 0;
+        table[i].inputs = layers[i].no_inputs();
+        table[i].outputs = layers[i].no_outputs();
+        table[i].offset = put(buf, &w.data()[0], w.data().size() * sizeof(Real));
+    }
+    std::memcpy(&buf[h.layers_offset], &table[0], table.size() * sizeof(ModelLayer));
+
+    h.file_size = buf.size();
+    boost::crc_32_type crc;
+    crc.process_bytes(&buf[align(sizeof(h))], buf.size() - align(sizeof(h)));
+    h.checksum = crc.checksum();
+    std::memcpy(&buf[0], &h, sizeof(h));
+
+    std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs.write(&buf[0], buf.size())) throw std::runtime_error("Unable to write model " + filename);
+}
@@ -0,0 +1,78 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef MODELFILE_HPP_
+#define MODELFILE_HPP_
+
+#include "inference.hpp"
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/**
+ * Classifier model stored in a binary file mapped into memory.
+ * Weights are used in place (see plan()), so loading takes no time regardless of the model size.
+ *
+ * File layout (host byte order, sections aligned to 64 bytes):
+ *   header: magic, version, size of Real, input size, number of labels and layers,
+ *           section positions, file size, CRC-32 of everything past the header
+ *   labels: label names separated by ';'
+ *   normalization: mean and standard deviation vectors
+ *   layer table: activation identifier, input and output size, weights position
+ *   weights: (inputs + 1) x outputs matrices stored by rows, bias weights first
+ */
+class ModelFile : boost::noncopyable {
+    public:
+        typedef InferencePlan::Layer Layer;
+        typedef InferencePlan::LayerList LayerList;
+
+    public:
+        /**
+         * map a model file
+         * @param filename model file name
+         * @param verify check the checksum too (reads the whole file, only the header is checked otherwise)
+         */
+        explicit ModelFile(const std::string& filename, bool verify = false);
+
+        /// output labels
+        const LabelList& labels() const { return labels_; }
+        /// network layers
+        const LayerList& layers() const { return layers_; }
+        /// input vector size
+        size_t input_size() const { return in_size; }
+        /// output vector size
+        size_t output_size() const { return layers_.back().outputs; }
+        /// mean vector
+        const Real* mean() const { return mean_; }
+        /// standard deviation vector
+        const Real* stddev() const { return stddev_; }
+
+        /// inference plan using the mapped weights in place
+        InferencePlan plan() const;
+        /// copy of the mapped network
+        NeuralNet network() const;
+
+        /// check whether given file is a binary model file
+        static bool is_model(const std::string& filename);
+        /// write a binary model file
+        static void write(const std::string& filename, const LabelList& labels,
+                          const FeatureVector& mean, const FeatureVector& stddev, const NeuralNet& nn);
+
+    private:
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+        LabelList labels_;
+        LayerList layers_;
+        size_t in_size;
+        const Real *mean_, *stddev_;
+};
+
+#endif // MODELFILE_HPP_
@@ -8,6 +8,8 @@
 
 
 #include "neuralnet.hpp"
+#include <stdexcept>
+#include <algorithm>
 #include <boost/numeric/ublas/vector_proxy.hpp>
 #include <boost/numeric/ublas/io.hpp>
 
@@ -60,6 +62,83 @@ void NeuralNet::load(std::istream& is)
     while (is >> l) add_layer(l);
 }
 
+void NeuralNet::prune(Real fraction, const std::vector<Vector>& input_scales)
+{
+    for (size_t i = 0; i < layers.size(); ++i)
+        layers[i].prune(fraction, i < input_scales.size() ? input_scales[i] : Vector());
+}
+
+Real NeuralNet::sparsity() const
+{
+    size_t zeros = 0, total = 0;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        zeros += layers[i].zeros();
+        total += layers[i].no_inputs() * layers[i].no_outputs();
+    }
+    return total ? Real(zeros) / total : 0.0;
+}
+
+void NeuralNet::get_weights(std::vector<Numeric>& w) const
+{
+    w.clear();
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const Matrix& m = layers[i].weight_matrix();
+        w.insert(w.end(), m.data().begin(), m.data().end());
+    }
+}
+
+void NeuralNet::set_weights(const std::vector<Numeric>& w)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        Matrix m(layers[i].weight_matrix().size1(), layers[i].weight_matrix().size2());
+        if (pos + m.data().size() > w.size()) throw std::runtime_error("Not enough weights for the network");
+        std::copy(w.begin() + pos, w.begin() + pos + m.data().size(), m.data().begin());
+        pos += m.data().size();
+        NNLayer l(m, layers[i].activation());
+        layers[i].swap(l);
+    }
+    if (pos != w.size()) throw std::runtime_error("Too many weights for the network");
+}
+
+Real NeuralNet::gradient(const Vector& input, const Vector& output, std::vector<Numeric>& g) const
+{
+    std::vector<Vector> results(layers.size() + 1);
+    results[0] = input;
+    for (size_t l = 0; l < layers.size(); ++l)
+        results[l + 1] = layers[l].exec(results[l]);
+    Vector err = output - results.back();
+
+    std::vector<size_t> offset(layers.size() + 1, 0);
+    for (size_t l = 0; l < layers.size(); ++l)
+        offset[l + 1] = offset[l] + layers[l].weight_matrix().data().size();
+    if (g.empty()) g.assign(offset.back(), 0.0);
+    if (g.size() != offset.back()) throw std::runtime_error("Gradient size does not match the network");
+
+    // derivative of the error wrt. the potentials of a layer, from the last one backwards
+    Vector delta = element_prod(layers.back().activation().df(results[layers.size() - 1], layers.back(), results.back()), err);
+    delta *= -2.0;
+    for (size_t l = layers.size(); l-- > 0; ) {
+        const Matrix& w = layers[l].weight_matrix();
+        const Vector& x = results[l];
+        size_t outs = w.size2();
+        Numeric* gl = &g[offset[l]];
+        for (size_t o = 0; o < outs; ++o) gl[o] += delta(o);
+        for (size_t i = 0; i < x.size(); ++i)
+            for (size_t o = 0; o < outs; ++o) gl[(i + 1) * outs + o] += x(i) * delta(o);
+        if (l == 0) break;
+
+        Vector back(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+            Numeric sum = 0.0;
+            for (size_t o = 0; o < outs; ++o) sum += w(i + 1, o) * delta(o);
+            back(i) = sum;
+        }
+        delta = element_prod(back, layers[l - 1].activation().df(results[l - 1], layers[l - 1], x));
+    }
+    return inner_prod(err, err);
+}
+
 std::istream& operator>>(std::istream& is, NeuralNet& nn) { nn.load(is); return is; }
 
 std::ostream& operator<<(std::ostream& os, const NeuralNet& nn)
@@ -71,11 +150,11 @@ std::ostream& operator<<(std::ostream& os, const NeuralNet& nn)
 
 
 
-NeuralNet::Teacher::Teacher(NeuralNet& nn, bool randomize)
+NeuralNet::Teacher::Teacher(NeuralNet& nn, bool randomize, bool keep_zeros)
 {
     teachers.resize(nn.layers.size());
     for (size_t i = 0; i < nn.layers.size(); ++i)
-        teachers[i] = (new NNLayer::Teacher(nn.layers[i], randomize));
+        teachers[i] = (new NNLayer::Teacher(nn.layers[i], randomize, keep_zeros));
 }
 
 NeuralNet::Teacher::~Teacher()
@@ -42,6 +42,24 @@ class NeuralNet {
         size_t no_outputs() const;
         /// load from input stream
         void load(std::istream& is);
+        /**
+         * zero the least important input weights of every layer
+         * @param fraction fraction of input weights of every layer to be zero afterwards
+         * @param input_scales typical input magnitudes of every layer (plain weight magnitudes if empty)
+         */
+        void prune(Real fraction, const std::vector<Vector>& input_scales = std::vector<Vector>());
+        /// fraction of zero input weights
+        Real sparsity() const;
+        /// all weights of the network, layer by layer, each row by row
+        void get_weights(std::vector<Numeric>& w) const;
+        /// set all weights (as returned by get_weights())
+        void set_weights(const std::vector<Numeric>& w);
+        /**
+         * add the gradient of the squared error of a sample wrt. all weights to @a g
+         * (laid out as by get_weights(), zero-initialized if empty)
+         * @return squared error of the sample
+         */
+        Real gradient(const Vector& input, const Vector& output, std::vector<Numeric>& g) const;
 
     public:
 
@@ -51,7 +69,8 @@ class NeuralNet {
                 typedef std::vector<NNLayer::Teacher*> LayerTeacherArray;
 
                 /// New network learning context
-                explicit Teacher(NeuralNet& nn, bool randomize = true);
+                /// @param keep_zeros zero weights are not trained (keeps a pruned network sparse)
+                explicit Teacher(NeuralNet& nn, bool randomize = true, bool keep_zeros = false);
                 /// Destructor
                 ~Teacher();
                 /// present sample vector and its desired output
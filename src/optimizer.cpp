@@ -0,0 +1,177 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "optimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+const Real RPROP_INIT = 0.1;     // initial step size
+const Real RPROP_MIN = 1e-6;     // minimum step size
+const Real RPROP_GROW = 1.2;     // step size factor while the gradient sign is kept
+const Real RPROP_SHRINK = 0.5;   // step size factor when the gradient sign flips
+const Real ARMIJO = 1e-4;        // fraction of the linear decrease a step has to achieve
+const size_t MAX_BACKTRACK = 20; // step halvings before a search direction is given up
+const Real MIN_CURVATURE = 1e-10; // smallest y . s / y . y kept in the L-BFGS memory
+
+/// dot product
+static Real dot(const BatchOptimizer::Weights& a, const BatchOptimizer::Weights& b)
+{
+    Real r = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) r += a[i] * b[i];
+    return r;
+}
+
+std::auto_ptr<BatchOptimizer> BatchOptimizer::create(Method m)
+{
+    switch (m) {
+        case RPROP: return std::auto_ptr<BatchOptimizer>(new RpropOptimizer);
+        case LBFGS: return std::auto_ptr<BatchOptimizer>(new LbfgsOptimizer);
+    }
+    throw std::runtime_error("Unknown optimization method");
+}
+
+BatchOptimizer::Method BatchOptimizer::parse_method(const std::string& name)
+{
+    if (name == "rprop") return RPROP;
+    if (name == "lbfgs") return LBFGS;
+    throw std::runtime_error("Unknown training method: " + name);
+}
+
+void BatchOptimizer::evaluate(const Weights& w, Objective& obj)
+{
+    if (!g.empty() && x == w) return;
+    f = obj.evaluate(w, g);
+    x = w;
+    ++n_eval;
+}
+
+RpropOptimizer::RpropOptimizer() : f_prev(0.0) {}
+
+void RpropOptimizer::reset()
+{
+    x.clear();
+    g.clear();
+    delta.clear();
+}
+
+void RpropOptimizer::step(Weights& w, Objective& obj, Real max_step)
+{
+    evaluate(w, obj);
+    if (delta.size() != w.size()) {
+        delta.assign(w.size(), RPROP_INIT);
+        g_prev.assign(w.size(), 0.0);
+        dw_prev.assign(w.size(), 0.0);
+        f_prev = f;
+    }
+
+    bool rose = (f > f_prev);
+    for (size_t i = 0; i < w.size(); ++i) {
+        Real sign = g_prev[i] * g[i], dw = 0.0;
+        if (sign > 0.0) {
+            delta[i] = std::min(delta[i] * RPROP_GROW, max_step);
+        } else if (sign < 0.0) {
+            // the minimum was jumped over, take the move back only if the error rose
+            delta[i] = std::max(delta[i] * RPROP_SHRINK, RPROP_MIN);
+            if (rose) dw = -dw_prev[i];
+            w[i] += dw;
+            dw_prev[i] = dw;
+            g_prev[i] = 0.0;
+            continue;
+        } else {
+            delta[i] = std::min(delta[i], max_step);
+        }
+        if (g[i] > 0.0) dw = -delta[i];
+        else if (g[i] < 0.0) dw = delta[i];
+        w[i] += dw;
+        dw_prev[i] = dw;
+        g_prev[i] = g[i];
+    }
+    f_prev = f;
+}
+
+LbfgsOptimizer::LbfgsOptimizer(size_t memory) : memory(std::max<size_t>(memory, 1)) {}
+
+void LbfgsOptimizer::reset()
+{
+    x.clear();
+    g.clear();
+    s.clear();
+    y.clear();
+    rho.clear();
+}
+
+void LbfgsOptimizer::step(Weights& w, Objective& obj, Real max_step)
+{
+    evaluate(w, obj);
+    size_t n = w.size();
+
+    // two-loop recursion: d = -H g
+    Weights d(n);
+    for (size_t i = 0; i < n; ++i) d[i] = -g[i];
+    std::vector<Real> alpha(s.size());
+    for (size_t k = s.size(); k-- > 0; ) {
+        alpha[k] = rho[k] * dot(s[k], d);
+        for (size_t i = 0; i < n; ++i) d[i] -= alpha[k] * y[k][i];
+    }
+    if (!s.empty()) {
+        Real gamma = dot(s.back(), y.back()) / dot(y.back(), y.back());
+        for (size_t i = 0; i < n; ++i) d[i] *= gamma;
+    }
+    for (size_t k = 0; k < s.size(); ++k) {
+        Real beta = rho[k] * dot(y[k], d);
+        for (size_t i = 0; i < n; ++i) d[i] += (alpha[k] - beta) * s[k][i];
+    }
+
+    Real slope = dot(g, d);
+    if (slope >= 0.0) {
+        // not a descent direction, fall back to steepest descent
+        s.clear(); y.clear(); rho.clear();
+        for (size_t i = 0; i < n; ++i) d[i] = -g[i];
+        slope = dot(g, d);
+        if (slope == 0.0) return;
+    }
+
+    // without curvature information the step is the gradient, no weight moves by more than max_step then
+    Real t = 1.0;
+    if (s.empty()) {
+        Real longest = 0.0;
+        for (size_t i = 0; i < n; ++i) longest = std::max(longest, std::fabs(d[i]));
+        if (longest > max_step) t = max_step / longest;
+    }
+
+    Weights xt(n), gt;
+    for (size_t k = 0; k < MAX_BACKTRACK; ++k, t *= 0.5) {
+        for (size_t i = 0; i < n; ++i) xt[i] = w[i] + t * d[i];
+        Real ft = obj.evaluate(xt, gt);
+        ++n_eval;
+        if (!(ft <= f + ARMIJO * t * slope)) continue;
+
+        Weights sk(n), yk(n);
+        for (size_t i = 0; i < n; ++i) {
+            sk[i] = xt[i] - w[i];
+            yk[i] = gt[i] - g[i];
+        }
+        Real sy = dot(sk, yk), yy = dot(yk, yk);
+        if (yy > 0.0 && sy > MIN_CURVATURE * yy) {
+            s.push_back(sk);
+            y.push_back(yk);
+            rho.push_back(1.0 / sy);
+            if (s.size() > memory) {
+                s.pop_front(); y.pop_front(); rho.pop_front();
+            }
+        }
+        w = x = xt;
+        g.swap(gt);
+        f = ft;
+        return;
+    }
+
+    // the error did not fall along the direction, start over from steepest descent
+    s.clear(); y.clear(); rho.clear();
+}
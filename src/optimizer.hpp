@@ -0,0 +1,113 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef OPTIMIZER_HPP_
+#define OPTIMIZER_HPP_
+
+#include "common.hpp"
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Full-batch minimization of the training error.
+ * Every iteration takes the exact gradient over the whole training set,
+ * so that each of them is worth many chunked backpropagation updates.
+ * Weights are flat vectors in the layout of NeuralNet::get_weights().
+ */
+class BatchOptimizer {
+    public:
+        typedef std::vector<Real> Weights;
+
+        /// function to be minimized
+        class Objective {
+            public:
+                /// destructor
+                virtual ~Objective() {}
+                /// value at @a w and its gradient @a g
+                virtual Real evaluate(const Weights& w, Weights& g) = 0;
+        };
+
+        /// optimization methods
+        enum Method {
+            RPROP, ///< iRPROP+ (per-weight step sizes adapted by gradient signs)
+            LBFGS  ///< limited memory BFGS with a backtracking line search
+        };
+
+    public:
+        /// destructor
+        virtual ~BatchOptimizer() {}
+        /// create an optimizer
+        static std::auto_ptr<BatchOptimizer> create(Method m);
+        /// parse method name (rprop, lbfgs)
+        static Method parse_method(const std::string& name);
+
+        /**
+         * do one iteration
+         * @param w weights, updated in place
+         * @param obj objective function
+         * @param max_step maximum change of a weight
+         */
+        virtual void step(Weights& w, Objective& obj, Real max_step) = 0;
+        /// forget the state gathered so far (e.g. the weights were restored)
+        virtual void reset() = 0;
+
+        /// objective value at the weights of the last iteration (before its update for RPROP)
+        Real value() const { return f; }
+        /// number of objective evaluations (training passes)
+        size_t evaluations() const { return n_eval; }
+
+    protected:
+        explicit BatchOptimizer() : f(0.0), n_eval(0) {}
+        /// evaluate the objective at @a w unless it is known already (the weights were not changed)
+        void evaluate(const Weights& w, Objective& obj);
+
+    protected:
+        Weights x, g; ///< weights the objective is known at and its gradient (empty if none)
+        Real f;       ///< objective value at x
+        size_t n_eval;
+};
+
+/**
+ * iRPROP+: every weight moves by its own step size against the sign of its
+ * partial derivative, the step grows while the sign is kept and shrinks when
+ * it flips; a flip after the error rose takes the previous move back.
+ */
+class RpropOptimizer : public BatchOptimizer {
+    public:
+        explicit RpropOptimizer();
+        void step(Weights& w, Objective& obj, Real max_step);
+        void reset();
+
+    private:
+        Weights delta;   ///< step sizes
+        Weights g_prev;  ///< previous gradient (zero after a sign flip)
+        Weights dw_prev; ///< previous weight change
+        Real f_prev;     ///< previous error
+};
+
+/**
+ * L-BFGS: the inverse Hessian is approximated from the last few steps
+ * and gradient changes; steps are shortened until the error falls enough
+ * (Armijo condition).
+ */
+class LbfgsOptimizer : public BatchOptimizer {
+    public:
+        explicit LbfgsOptimizer(size_t memory = 7);
+        void step(Weights& w, Objective& obj, Real max_step);
+        void reset();
+
+    private:
+        size_t memory;
+        std::deque<Weights> s, y; ///< recent weight and gradient changes
+        std::deque<Real> rho;     ///< 1 / (y . s) of every pair
+};
+
+#endif // OPTIMIZER_HPP_
@@ -0,0 +1,232 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "pipeline.hpp"
+#include "profile.hpp"
+#include "timer.hpp"
+#include <map>
+#include <stdexcept>
+#include <WaveFile.h>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+/// record passed through the pipeline
+struct ClassifyPipeline::Item {
+    size_t idx;                              ///< position in the input
+    boost::shared_ptr<Aquila::WaveFile> wav; ///< decoded record (until extracted)
+    DataSet data;                            ///< record features (until classified)
+    Classifier::Vector result;               ///< classification result
+    size_t frames, silent;
+    std::string error;                       ///< failure description
+};
+
+ClassifyPipeline::Options::Options() :
+    readers(1), extractors(std::max(boost::thread::hardware_concurrency(), 1u)), inference(1), queue_size(8) {}
+
+ClassifyPipeline::Options ClassifyPipeline::Options::parse(const std::string& str)
+{
+    std::vector<std::string> v;
+    boost::algorithm::split(v, str, boost::algorithm::is_any_of(":"));
+    if (v.size() != 3) throw std::runtime_error("Pipeline threads expected as <readers>:<extractors>:<inference>");
+    Options o;
+    o.readers    = std::max<size_t>(boost::lexical_cast<size_t>(v[0]), 1);
+    o.extractors = std::max<size_t>(boost::lexical_cast<size_t>(v[1]), 1);
+    o.inference  = std::max<size_t>(boost::lexical_cast<size_t>(v[2]), 1);
+    return o;
+}
+
+ClassifyPipeline::Stats::Stats() :
+    files(0), failed(0), frames(0), silent(0), wall_time(0.0), read_time(0.0), extract_time(0.0), infer_time(0.0),
+    read_waits(0), extract_waits(0), infer_waits(0) {}
+
+ClassifyPipeline::ClassifyPipeline(const Classifier& c, const Options& o) :
+    cls(c), opt(o), files(0), next_file(0), read_q(0), extract_q(0), infer_q(0) {}
+
+void ClassifyPipeline::add_time(double& total, double t)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    total += t;
+}
+
+void ClassifyPipeline::read()
+{
+    double busy = 0.0;
+    for (;;) {
+        ItemPtr item(new Item);
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (next_file == files->size()) break;
+            item->idx = next_file++;
+        }
+        item->frames = item->silent = 0;
+        double t = wall_time();
+        try {
+            item->wav.reset(Features::read_wave((*files)[item->idx]).release());
+        } catch (std::exception& e) {
+            item->error = e.what();
+        }
+        busy += wall_time() - t;
+        if (!read_q->push(item)) break;
+    }
+    add_time(stats_.read_time, busy);
+    read_q->done();
+}
+
+void ClassifyPipeline::extract()
+{
+    double busy = 0.0;
+    ItemPtr item;
+    while (read_q->pop(item)) {
+        double t = wall_time();
+        if (item->error.empty()) {
+            try {
+                item->data.add_record(*item->wav, FeatureVector(), opt.selection);
+                item->silent = item->data.silent();
+            } catch (std::exception& e) {
+                item->error = e.what();
+            }
+        }
+        item->wav.reset();
+        busy += wall_time() - t;
+        if (!extract_q->push(item)) break;
+    }
+    add_time(stats_.extract_time, busy);
+    extract_q->done();
+}
+
+void ClassifyPipeline::infer()
+{
+    double busy = 0.0;
+    ItemPtr item;
+    while (extract_q->pop(item)) {
+        double t = wall_time();
+        if (item->error.empty()) {
+            try {
+                item->frames = item->data.count();
+                item->result = cls.exec(item->data);
+            } catch (std::exception& e) {
+                item->error = e.what();
+            }
+        }
+        item->data.clear();
+        busy += wall_time() - t;
+        if (!infer_q->push(item)) break;
+    }
+    add_time(stats_.infer_time, busy);
+    infer_q->done();
+}
+
+void ClassifyPipeline::stage(void (ClassifyPipeline::*body)())
+{
+    try {
+        (this->*body)();
+    } catch (...) {
+        fail();
+    }
+}
+
+void ClassifyPipeline::fail()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!error) error = boost::current_exception();
+    }
+    // stages blocked on any of the queues give up, so that the threads can be joined
+    read_q->close();
+    extract_q->close();
+    infer_q->close();
+}
+
+/// writes results as a tab-separated table
+class TableSink : public ClassifyPipeline::Sink {
+    public:
+        TableSink(const LabelList& labels, std::ostream& os, std::ostream& err) : os(os), err(err)
+        {
+            os << "file\tframes";
+            for (size_t l = 0; l < labels.size(); ++l) os << '\t' << labels[l];
+            os << std::endl;
+        }
+        void result(const std::string& file, size_t frames, const Classifier::Vector& scores)
+        {
+            os << file << '\t' << frames;
+            for (size_t l = 0; l < scores.size(); ++l) os << '\t' << scores(l);
+            os << '\n';
+        }
+        void failed(const std::string& file, const std::string& error)
+        {
+            err << "ERROR: " << file << ": " << error << std::endl;
+        }
+    private:
+        std::ostream &os, &err;
+};
+
+const ClassifyPipeline::Stats& ClassifyPipeline::run(const std::vector<std::string>& f, std::ostream& os, std::ostream& err)
+{
+    TableSink sink(cls.labels(), os, err);
+    run(f, sink);
+    os.flush();
+    return stats_;
+}
+
+const ClassifyPipeline::Stats& ClassifyPipeline::run(const std::vector<std::string>& f, Sink& sink)
+{
+    BoundedQueue<ItemPtr> rq(opt.queue_size, opt.readers), eq(opt.queue_size, opt.extractors), iq(opt.queue_size, opt.inference);
+    read_q = &rq;
+    extract_q = &eq;
+    infer_q = &iq;
+    files = &f;
+    next_file = 0;
+    error = boost::exception_ptr();
+    stats_ = Stats();
+    double start = wall_time();
+
+    boost::thread_group threads;
+    for (size_t i = 0; i < opt.readers; ++i)    threads.create_thread(boost::bind(&ClassifyPipeline::stage, this, &ClassifyPipeline::read));
+    for (size_t i = 0; i < opt.extractors; ++i) threads.create_thread(boost::bind(&ClassifyPipeline::stage, this, &ClassifyPipeline::extract));
+    for (size_t i = 0; i < opt.inference; ++i)  threads.create_thread(boost::bind(&ClassifyPipeline::stage, this, &ClassifyPipeline::infer));
+
+    // output stage, results are passed on in input order
+    try {
+        std::map<size_t, ItemPtr> done;
+        size_t next_out = 0;
+        ItemPtr item;
+        while (iq.pop(item)) {
+            done[item->idx] = item;
+            std::map<size_t, ItemPtr>::iterator i;
+            while ((i = done.find(next_out)) != done.end()) {
+                const Item& it = *i->second;
+                ++stats_.files;
+                if (!it.error.empty()) {
+                    ++stats_.failed;
+                    sink.failed(f[it.idx], it.error);
+                } else {
+                    stats_.frames += it.frames;
+                    stats_.silent += it.silent;
+                    sink.result(f[it.idx], it.frames, it.result);
+                }
+                done.erase(i);
+                ++next_out;
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+    threads.join_all();
+
+    stats_.wall_time = wall_time() - start;
+    stats_.read_waits = rq.producer_waits();
+    stats_.extract_waits = eq.producer_waits();
+    stats_.infer_waits = iq.producer_waits();
+    read_q = extract_q = infer_q = 0;
+    files = 0;
+    if (error) boost::rethrow_exception(error);
+    return stats_;
+}
@@ -0,0 +1,106 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include "classifier.hpp"
+#include "queue.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/exception_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Batch classification of many records by a pipeline of stages:
+ * reading (wave decoding), feature extraction, inference and output.
+ * Stages run in their own threads connected by bounded queues, so that
+ * different records are read, extracted and classified at the same time.
+ */
+class ClassifyPipeline : boost::noncopyable {
+    public:
+        /// stage thread counts and queue capacity
+        struct Options {
+            size_t readers, extractors, inference; ///< number of threads of the stages
+            size_t queue_size;                     ///< capacity of the queues between stages
+            FrameSelection selection;              ///< frames of records to classify (all by default)
+            /// one reader and inference thread, an extractor per CPU
+            Options();
+            /// parse thread counts given as <readers>:<extractors>:<inference>
+            static Options parse(const std::string& str);
+        };
+
+        /// pipeline run statistics
+        struct Stats {
+            size_t files, failed, frames;
+            size_t silent;                         ///< frames dropped by the energy gate
+            double wall_time;                      ///< total time
+            double read_time, extract_time, infer_time; ///< time spent in stages (summed over threads)
+            size_t read_waits, extract_waits, infer_waits; ///< times a stage waited for a full output queue
+            Stats();
+        };
+
+        /// receiver of classification results, called from the output stage in input order
+        class Sink {
+            public:
+                virtual ~Sink() {}
+                /// record classified
+                virtual void result(const std::string& file, size_t frames, const Classifier::Vector& scores) = 0;
+                /// record failed
+                virtual void failed(const std::string& file, const std::string& error) = 0;
+        };
+
+    public:
+        /// constructor
+        explicit ClassifyPipeline(const Classifier& c, const Options& opt = Options());
+
+        /**
+         * Classify records and write results in input order, one tab-separated
+         * line per record: file name, number of frames and log-score of every label.
+         * A header line with label names is written first. Failures of single
+         * records are reported, other errors stop the pipeline and are rethrown.
+         * @param files .wav files to classify
+         * @param os results output
+         * @param err failed records are reported here
+         */
+        const Stats& run(const std::vector<std::string>& files, std::ostream& os, std::ostream& err);
+
+        /// classify records, passing results to @a sink
+        const Stats& run(const std::vector<std::string>& files, Sink& sink);
+
+        /// statistics of the last run
+        const Stats& stats() const { return stats_; }
+
+    private:
+        struct Item;
+        typedef boost::shared_ptr<Item> ItemPtr;
+
+        void read();
+        void extract();
+        void infer();
+        /// run a stage, stopping the pipeline if it fails
+        void stage(void (ClassifyPipeline::*body)());
+        /// save the exception being handled and close all queues
+        void fail();
+        void add_time(double& total, double t);
+
+    private:
+        const Classifier& cls;
+        Options opt;
+        const std::vector<std::string>* files;
+        size_t next_file;
+        boost::mutex mutex;
+        BoundedQueue<ItemPtr> *read_q, *extract_q, *infer_q;
+        boost::exception_ptr error; ///< first failure of a stage
+        Stats stats_;
+};
+
+#endif // PIPELINE_HPP_
@@ -0,0 +1,103 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "prefetch.hpp"
+#include "timer.hpp"
+#include <stdexcept>
+#include <boost/bind/bind.hpp>
+
+Prefetcher::Stats::Stats() : batches(0), stalls(0), stall_time(0.0), load_time(0.0), depth_sum(0) {}
+
+Prefetcher::Stats& Prefetcher::Stats::operator+=(const Stats& s)
+{
+    batches    += s.batches;
+    stalls     += s.stalls;
+    stall_time += s.stall_time;
+    load_time  += s.load_time;
+    depth_sum  += s.depth_sum;
+    return *this;
+}
+
+Prefetcher::Prefetcher(const SampleSource& s, const std::vector<size_t>& o, size_t d) :
+    src(s), order(o), depth(std::max<size_t>(d, 1)), batches(depth + 1),
+    current(0), delivered(0), stop(false)
+{
+    for (size_t i = 0; i < batches.size(); ++i) free_.push_back(&batches[i]);
+    thread.reset(new boost::thread(boost::bind(&Prefetcher::run, this)));
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    thread->join();
+}
+
+void Prefetcher::run()
+{
+    for (size_t i = 0; i < order.size(); ++i) {
+        Batch* b;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while (free_.empty() && !stop) cond.wait(lock);
+            if (stop) return;
+            b = free_.front();
+            free_.pop_front();
+        }
+
+        double t = wall_time();
+        try {
+            b->data = &src.block(order[i], b->storage);
+        } catch (std::exception& e) {
+            boost::mutex::scoped_lock lock(mutex);
+            error = e.what();
+            stop = true;
+            cond.notify_all();
+            return;
+        }
+        t = wall_time() - t;
+
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            stats_.load_time += t;
+            ready.push_back(b);
+        }
+        cond.notify_all();
+    }
+}
+
+const Prefetcher::DataSampleList* Prefetcher::next()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    // hand the previous buffer back to the loader
+    if (current) {
+        free_.push_back(current);
+        current = 0;
+        cond.notify_all();
+    }
+    if (delivered == order.size()) return 0;
+
+    if (ready.empty()) {
+        double t = wall_time();
+        while (ready.empty() && error.empty()) cond.wait(lock);
+        ++stats_.stalls;
+        stats_.stall_time += wall_time() - t;
+    }
+    if (!error.empty()) throw std::runtime_error("Data loading failed: " + error);
+
+    stats_.depth_sum += ready.size();
+    ++stats_.batches;
+    ++delivered;
+    current = ready.front();
+    ready.pop_front();
+    return current->data;
+}
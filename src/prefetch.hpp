@@ -0,0 +1,94 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef PREFETCH_HPP_
+#define PREFETCH_HPP_
+
+#include "features.hpp"
+#include <deque>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/**
+ * Background loader of sample blocks.
+ * A loader thread reads blocks of a sample source in given order
+ * (including normalization and conversion done by the source)
+ * into a bounded queue of buffers while the consumer works on
+ * the previously loaded block.
+ */
+class Prefetcher : boost::noncopyable {
+    public:
+        typedef SampleSource::DataSampleList DataSampleList;
+
+        /// loader statistics
+        struct Stats {
+            size_t batches;    ///< number of batches delivered
+            size_t stalls;     ///< number of times the consumer had to wait for data
+            double stall_time; ///< time the consumer spent waiting for data [s]
+            double load_time;  ///< time the loader spent reading blocks [s]
+            size_t depth_sum;  ///< sum of queue depths seen by the consumer
+
+            Stats();
+            /// accumulate statistics
+            Stats& operator+=(const Stats& s);
+            /// average queue depth seen by the consumer
+            double avg_depth() const { return batches ? double(depth_sum) / batches : 0.0; }
+        };
+
+    public:
+        /**
+         * start loading blocks
+         * @param src sample source
+         * @param order indices of blocks to load
+         * @param depth maximum number of loaded blocks waiting in the queue
+         */
+        explicit Prefetcher(const SampleSource& src, const std::vector<size_t>& order, size_t depth = 2);
+        /// stop the loader thread
+        ~Prefetcher();
+
+        /**
+         * get the next block
+         * @return block samples or 0 if all blocks have been delivered;
+         * the block is valid until the next call
+         */
+        const DataSampleList* next();
+
+        /// loader statistics
+        const Stats& stats() const { return stats_; }
+
+    private:
+        /// loaded block
+        struct Batch {
+            DataSampleList storage;     ///< storage for block data
+            const DataSampleList* data; ///< block data (either storage or the source memory)
+        };
+        typedef std::deque<Batch*> BatchQueue;
+
+        void run(); ///< loader thread body
+
+    private:
+        const SampleSource& src;
+        std::vector<size_t> order;
+        size_t depth;
+        std::vector<Batch> batches;  ///< batch buffers
+        BatchQueue ready, free_;     ///< loaded and free buffers
+        Batch* current;              ///< buffer held by the consumer
+        size_t delivered;            ///< blocks handed to the consumer
+        bool stop;                   ///< loader stop request
+        std::string error;           ///< loader error message
+        Stats stats_;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        boost::scoped_ptr<boost::thread> thread;
+};
+
+#endif // PREFETCH_HPP_
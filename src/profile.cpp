@@ -0,0 +1,144 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "profile.hpp"
+#include <map>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+const size_t MAX_TRACE_EVENTS = 1 << 20; // further phase instances are only summed
+
+/// accumulated time of a phase
+struct PhaseTime {
+    size_t calls;
+    double total, max;
+    PhaseTime() : calls(0), total(0.0), max(0.0) {}
+};
+
+/// single phase instance kept for the trace
+struct TraceEvent {
+    const char* name;
+    unsigned tid;
+    double start, duration;
+};
+
+/// collected data, guarded by the mutex
+struct ProfileData {
+    boost::mutex mutex;
+    bool trace;
+    std::map<std::string, PhaseTime> phases;
+    std::map<std::string, size_t> counters;
+    std::vector<TraceEvent> events;
+    size_t dropped_events;
+    std::map<boost::thread::id, unsigned> threads; ///< small trace thread ids in order of appearance
+
+    ProfileData() : trace(false), dropped_events(0) {}
+};
+
+static ProfileData& data()
+{
+    static ProfileData d;
+    return d;
+}
+
+bool Profile::enabled_ = false;
+
+void Profile::enable(bool trace)
+{
+    ProfileData& d = data();
+    wall_time(); // start the clock
+    boost::mutex::scoped_lock lock(d.mutex);
+    d.trace = d.trace || trace;
+    enabled_ = true;
+}
+
+void Profile::record(const char* name, double start, double end)
+{
+    ProfileData& d = data();
+    boost::mutex::scoped_lock lock(d.mutex);
+    PhaseTime& p = d.phases[name];
+    ++p.calls;
+    p.total += end - start;
+    p.max = std::max(p.max, end - start);
+
+    if (!d.trace) return;
+    if (d.events.size() >= MAX_TRACE_EVENTS) { ++d.dropped_events; return; }
+    std::map<boost::thread::id, unsigned>::iterator t = d.threads.find(boost::this_thread::get_id());
+    if (t == d.threads.end())
+        t = d.threads.insert(std::make_pair(boost::this_thread::get_id(), unsigned(d.threads.size()))).first;
+    TraceEvent e = { name, t->second, start, end - start };
+    d.events.push_back(e);
+}
+
+void Profile::add(const char* name, size_t n)
+{
+    ProfileData& d = data();
+    boost::mutex::scoped_lock lock(d.mutex);
+    d.counters[name] += n;
+}
+
+/// order phases by total time, longest first
+static bool longer(const std::pair<std::string, PhaseTime>& a, const std::pair<std::string, PhaseTime>& b)
+{
+    return a.second.total > b.second.total;
+}
+
+void Profile::report(std::ostream& os)
+{
+    ProfileData& d = data();
+    boost::mutex::scoped_lock lock(d.mutex);
+
+    std::vector<std::pair<std::string, PhaseTime> > phases(d.phases.begin(), d.phases.end());
+    std::stable_sort(phases.begin(), phases.end(), longer);
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize prec = os.precision();
+    os << "=== Profile (" << wall_time() << " s)" << std::endl
+       << std::left << std::setw(16) << "phase" << std::right << std::setw(10) << "calls"
+       << std::setw(12) << "total s" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::endl;
+    os << std::fixed;
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const PhaseTime& p = phases[i].second;
+        os << std::left << std::setw(16) << phases[i].first << std::right << std::setw(10) << p.calls
+           << std::setprecision(3) << std::setw(12) << p.total
+           << std::setw(12) << 1000.0 * p.total / p.calls << std::setw(12) << 1000.0 * p.max << std::endl;
+    }
+    for (std::map<std::string, size_t>::const_iterator c = d.counters.begin(); c != d.counters.end(); ++c)
+        os << std::left << std::setw(16) << c->first << std::right << std::setw(10) << c->second << std::endl;
+    if (d.dropped_events)
+        os << "--- trace truncated, " << d.dropped_events << " phase instances dropped" << std::endl;
+    os.flags(flags);
+    os.precision(prec);
+}
+
+void Profile::write_trace(const std::string& filename)
+{
+    ProfileData& d = data();
+    boost::mutex::scoped_lock lock(d.mutex);
+
+    std::ofstream ofs(filename.c_str());
+    if (!ofs) throw std::runtime_error("Unable to write " + filename);
+
+    // complete events ("ph": "X") with microsecond timestamps
+    ofs << "{\"traceEvents\": [" << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < d.events.size(); ++i) {
+        const TraceEvent& e = d.events[i];
+        ofs << (i ? ",\n" : "\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.tid
+            << ", \"ts\": " << 1e6 * e.start << ", \"dur\": " << 1e6 * e.duration << "}";
+    }
+    ofs << "\n], \"otherData\": {";
+    for (std::map<std::string, size_t>::const_iterator c = d.counters.begin(); c != d.counters.end(); ++c)
+        ofs << (c == d.counters.begin() ? "" : ", ") << '"' << c->first << "\": " << c->second;
+    ofs << "}}" << std::endl;
+    if (!ofs) throw std::runtime_error("Unable to write " + filename);
+}
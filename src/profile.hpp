@@ -0,0 +1,57 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef PROFILE_HPP_
+#define PROFILE_HPP_
+
+#include "timer.hpp"
+#include <string>
+#include <ostream>
+#include <boost/utility.hpp>
+
+/**
+ * Run instrumentation: named phase timers and event counters.
+ * Probes are placed around coarse phases (a record, a block, a training
+ * pass), so a disabled probe costs a single branch and an enabled one
+ * a short critical section. Phases may nest and run on several threads,
+ * their times are summed per name.
+ */
+class Profile {
+    public:
+        /// times the enclosing scope as phase @a name (a string literal)
+        class Scope : boost::noncopyable {
+            public:
+                explicit Scope(const char* name) : name(enabled_ ? name : 0), start(this->name ? wall_time() : 0.0) {}
+                ~Scope() { if (name) record(name, start, wall_time()); }
+            private:
+                const char* name;
+                double start;
+        };
+
+        /// start collecting, with @a trace every phase instance is kept for write_trace()
+        static void enable(bool trace = false);
+        /// whether probes are active
+        static bool enabled() { return enabled_; }
+        /// add @a n to counter @a name (a string literal)
+        static void count(const char* name, size_t n = 1) { if (enabled_) add(name, n); }
+
+        /// write phase times (longest first) and counters
+        static void report(std::ostream& os);
+        /// write collected phase instances in the Chrome trace event format
+        static void write_trace(const std::string& filename);
+
+    private:
+        static void record(const char* name, double start, double end);
+        static void add(const char* name, size_t n);
+
+    private:
+        static bool enabled_;
+};
+
+#endif // PROFILE_HPP_
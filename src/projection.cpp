@@ -0,0 +1,222 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "projection.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/numeric/ublas/io.hpp>
+
+using namespace boost::numeric::ublas;
+
+const size_t JACOBI_SWEEPS = 100;  // sweeps of the eigenvalue decomposition before giving up
+const Real JACOBI_EPS = 1e-12;     // relative size of off-diagonal elements considered zero
+
+/// sums of samples and of their outer products (upper triangle) for a covariance matrix
+struct Moments {
+    size_t n;
+    FeatureVector sum;
+    Projection::Matrix cross;
+
+    explicit Moments(size_t dim = 0) : n(0), sum(zero_vector<Real>(dim)), cross(zero_matrix<Real>(dim, dim)) {}
+
+    /// add samples [begin, end) of a block
+    void add(const SampleSource::DataSampleList* blk, size_t begin, size_t end)
+    {
+        size_t d = sum.size();
+        for (size_t s = begin; s < end; ++s) {
+            const FeatureVector& x = (*blk)[s].first;
+            for (size_t i = 0; i < d; ++i) {
+                sum(i) += x(i);
+                for (size_t j = i; j < d; ++j) cross(i, j) += x(i) * x(j);
+            }
+        }
+        n += end - begin;
+    }
+
+    /// merge moments of another part of the data
+    void merge(const Moments& m)
+    {
+        n += m.n;
+        sum += m.sum;
+        cross += m.cross;
+    }
+};
+
+/**
+ * eigenvalues and eigenvectors of a symmetric matrix by cyclic Jacobi rotations
+ * @param a the matrix, its diagonal holds the eigenvalues afterwards
+ * @param v eigenvectors by columns
+ */
+static void jacobi(Projection::Matrix& a, Projection::Matrix& v)
+{
+    size_t d = a.size1();
+    v = identity_matrix<Real>(d);
+    Real total = 0.0;
+    for (size_t i = 0; i < d; ++i)
+        for (size_t j = 0; j < d; ++j) total += a(i, j) * a(i, j);
+
+    for (size_t sweep = 0; sweep < JACOBI_SWEEPS; ++sweep) {
+        Real off = 0.0;
+        for (size_t p = 0; p < d; ++p)
+            for (size_t q = p + 1; q < d; ++q) off += a(p, q) * a(p, q);
+        if (off <= JACOBI_EPS * JACOBI_EPS * total) return;
+
+        for (size_t p = 0; p < d; ++p)
+            for (size_t q = p + 1; q < d; ++q) {
+                if (a(p, q) == 0.0) continue;
+                // rotation zeroing a(p, q)
+                Real theta = (a(q, q) - a(p, p)) / (2.0 * a(p, q));
+                Real t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                Real c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                for (size_t k = 0; k < d; ++k) {
+                    Real kp = a(k, p), kq = a(k, q);
+                    a(k, p) = c * kp - s * kq;
+                    a(k, q) = s * kp + c * kq;
+                }
+                for (size_t k = 0; k < d; ++k) {
+                    Real pk = a(p, k), qk = a(q, k);
+                    a(p, k) = c * pk - s * qk;
+                    a(q, k) = s * pk + c * qk;
+                }
+                for (size_t k = 0; k < d; ++k) {
+                    Real kp = v(k, p), kq = v(k, q);
+                    v(k, p) = c * kp - s * kq;
+                    v(k, q) = s * kp + c * kq;
+                }
+            }
+    }
+    throw std::runtime_error("Eigenvalue decomposition did not converge");
+}
+
+/// order eigenvalue indices by decreasing eigenvalue
+struct ByEigenvalue {
+    const Projection::Matrix* a;
+    bool operator()(size_t i, size_t j) const { return (*a)(i, i) > (*a)(j, j); }
+};
+
+Projection::Projection() : explained_(0.0) {}
+
+void Projection::fit(const SampleSource& data, size_t dims, bool whiten, size_t threads)
+{
+    Profile::Scope scope("projection");
+    size_t d = data.input_size();
+    if (data.count() < 2) throw std::runtime_error("Not enough data to fit a projection");
+    if (dims == 0 || dims > d) throw std::runtime_error("Projection must keep 1 to input size dimensions");
+    threads = std::max<size_t>(threads, 1);
+
+    // every thread accumulates a slice of every block, partial moments are merged afterwards
+    // (normalized data are centered, so plain sums do not cancel)
+    std::vector<Moments> parts(threads, Moments(d));
+    SampleSource::DataSampleList buf;
+    for (size_t b = 0; b < data.blocks(); ++b) {
+        const SampleSource::DataSampleList& blk = data.block(b, buf);
+        size_t n = blk.size();
+        if (threads == 1) {
+            parts[0].add(&blk, 0, n);
+            continue;
+        }
+        boost::thread_group group;
+        for (size_t t = 0; t < threads; ++t)
+            group.create_thread(boost::bind(&Moments::add, &parts[t], &blk, n * t / threads, n * (t + 1) / threads));
+        group.join_all();
+    }
+    Moments all(d);
+    for (size_t t = 0; t < threads; ++t) all.merge(parts[t]);
+
+    center = all.sum / Real(all.n);
+    Matrix cov(d, d);
+    for (size_t i = 0; i < d; ++i)
+        for (size_t j = i; j < d; ++j)
+            cov(i, j) = cov(j, i) = all.cross(i, j) / Real(all.n) - center(i) * center(j);
+
+    Matrix v;
+    jacobi(cov, v);
+    std::vector<size_t> order(d);
+    for (size_t i = 0; i < d; ++i) order[i] = i;
+    ByEigenvalue by_eigenvalue = { &cov };
+    std::sort(order.begin(), order.end(), by_eigenvalue);
+
+    Real trace = 0.0, kept = 0.0;
+    for (size_t i = 0; i < d; ++i) trace += std::max<Real>(cov(i, i), 0.0);
+    Real floor = JACOBI_EPS * std::max<Real>(cov(order[0], order[0]), JACOBI_EPS);
+    matrix.resize(dims, d, false);
+    for (size_t k = 0; k < dims; ++k) {
+        Real lambda = std::max<Real>(cov(order[k], order[k]), 0.0);
+        kept += lambda;
+        Real scale = whiten ? 1.0 / std::sqrt(std::max(lambda, floor)) : 1.0;
+        for (size_t i = 0; i < d; ++i) matrix(k, i) = v(i, order[k]) * scale;
+    }
+    explained_ = trace > 0.0 ? kept / trace : 1.0;
+    mean_ = data.mean();
+    stddev_ = data.stddev();
+}
+
+FeatureVector Projection::apply(const FeatureVector& in) const
+{
+    if (in.size() != input_size()) throw std::runtime_error("Input size does not match the projection");
+    return prod(matrix, in - center);
+}
+
+template <typename Output>
+void Projection::project(const SampleSource& data, Output& out) const
+{
+    if (data.input_size() != input_size()) throw std::runtime_error("Input size does not match the projection");
+
+    // samples are normalized by the statistics of their source, which need not be the fitted ones
+    FeatureVector m = data.mean(), s = data.stddev(), u(input_size());
+    SampleSource::DataSampleList buf;
+    for (size_t b = 0; b < data.blocks(); ++b) {
+        const SampleSource::DataSampleList& blk = data.block(b, buf);
+        for (size_t i = 0; i < blk.size(); ++i) {
+            const FeatureVector& x = blk[i].first;
+            for (size_t j = 0; j < u.size(); ++j)
+                u(j) = stddev_(j) == 0.0 ? 0.0 : (x(j) * s(j) + m(j) - mean_(j)) / stddev_(j);
+            out.add_sample(apply(u), blk[i].second);
+        }
+    }
+}
+
+void Projection::apply(const SampleSource& data, DataSet& out) const { project(data, out); }
+void Projection::apply(const SampleSource& data, DataStream::Writer& out) const { project(data, out); }
+
+NNLayer Projection::layer(const FeatureVector& out_mean, const FeatureVector& out_stddev) const
+{
+    if (out_mean.size() != output_size() || out_stddev.size() != output_size())
+        throw std::runtime_error("Output size does not match the projection");
+
+    // z = (P (u - center) - out_mean) / out_stddev, bias in row 0
+    Matrix w(input_size() + 1, output_size());
+    FeatureVector shift = prod(matrix, center);
+    for (size_t o = 0; o < output_size(); ++o) {
+        Real scale = out_stddev(o) == 0.0 ? 0.0 : 1.0 / out_stddev(o);
+        w(0, o) = -(shift(o) + out_mean(o)) * scale;
+        for (size_t i = 0; i < input_size(); ++i) w(i + 1, o) = matrix(o, i) * scale;
+    }
+    return NNLayer(w, linear_func);
+}
+
+void Projection::load(const std::string& filename)
+{
+    std::ifstream is(filename.c_str());
+    if (!is) throw std::runtime_error("Unable to open projection file " + filename);
+    is >> explained_ >> mean_ >> stddev_ >> center >> matrix;
+    if (!is || matrix.size2() != mean_.size() || stddev_.size() != mean_.size() || center.size() != mean_.size())
+        throw std::runtime_error("Invalid projection file " + filename);
+}
+
+void Projection::save(const std::string& filename) const
+{
+    std::ofstream os(filename.c_str());
+    if (!os) throw std::runtime_error("Unable to write projection file " + filename);
+    os << explained_ << std::endl << mean_ << ' ' << stddev_ << std::endl << center << std::endl << matrix << std::endl;
+}
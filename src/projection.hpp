@@ -0,0 +1,83 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef PROJECTION_HPP_
+#define PROJECTION_HPP_
+
+#include "features.hpp"
+#include "datastream.hpp"
+#include "layer.hpp"
+
+/**
+ * Linear projection of input vectors onto their principal components.
+ * Features of consecutive frames and their deltas are strongly correlated,
+ * a few components keep most of their variance. The projection is fitted
+ * on normalized data, datasets are projected when they are built and
+ * a classifier trained on projected data gets the projection as its first
+ * (linear) layer, so that it still takes unprojected inputs.
+ */
+class Projection {
+    public:
+        typedef NNLayer::Matrix Matrix;
+
+    public:
+        /// empty projection
+        explicit Projection();
+
+        /**
+         * fit the projection to the covariance of the data (accumulated on several threads)
+         * @param data samples normalized by their own statistics
+         * @param dims number of principal components kept
+         * @param whiten scale components to unit variance
+         * @param threads number of threads
+         */
+        void fit(const SampleSource& data, size_t dims, bool whiten = false, size_t threads = 1);
+
+        /// project an input normalized by mean() and stddev()
+        FeatureVector apply(const FeatureVector& in) const;
+        /// add projected samples of normalized data (whatever their statistics) to an unnormalized dataset
+        void apply(const SampleSource& data, DataSet& out) const;
+        /// write projected samples of normalized data into a binary stream
+        void apply(const SampleSource& data, DataStream::Writer& out) const;
+
+        /**
+         * the projection followed by normalization of its outputs as a linear layer
+         * @param out_mean, out_stddev normalization of the projected data
+         */
+        NNLayer layer(const FeatureVector& out_mean, const FeatureVector& out_stddev) const;
+
+        /// input vector size
+        size_t input_size() const { return matrix.size2(); }
+        /// output vector size
+        size_t output_size() const { return matrix.size1(); }
+        /// fraction of the variance of the data kept by the components
+        Real explained() const { return explained_; }
+        /// mean of the unnormalized inputs
+        const FeatureVector& mean() const { return mean_; }
+        /// standard deviation of the unnormalized inputs (the variance, as used for normalization)
+        const FeatureVector& stddev() const { return stddev_; }
+
+        /// load from a text file
+        void load(const std::string& filename);
+        /// write a text file
+        void save(const std::string& filename) const;
+        /// projection file of a dataset
+        static std::string filename_for(const std::string& dataset) { return dataset + ".projection"; }
+
+    private:
+        template <typename Output> void project(const SampleSource& data, Output& out) const;
+
+    private:
+        FeatureVector mean_, stddev_; ///< normalization of the inputs
+        FeatureVector center;         ///< mean of the normalized inputs
+        Matrix matrix;                ///< components by rows
+        Real explained_;
+};
+
+#endif // PROJECTION_HPP_
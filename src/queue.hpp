@@ -0,0 +1,92 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef QUEUE_HPP_
+#define QUEUE_HPP_
+
+#include <deque>
+#include <algorithm>
+#include <boost/utility.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/**
+ * Bounded blocking queue connecting threads of two processing stages.
+ * The queue is closed once all its producers are done, consumers then
+ * drain the remaining items. A queue closed by close() (e.g. when a stage
+ * fails) wakes up and stops all producers and consumers at once.
+ */
+template <typename T>
+class BoundedQueue : boost::noncopyable {
+    public:
+        /**
+         * constructor
+         * @param capacity maximum number of queued items
+         * @param producers number of producers that need to call done()
+         */
+        explicit BoundedQueue(size_t capacity, size_t producers = 1) :
+            capacity(std::max<size_t>(capacity, 1)), producers(producers), closed(false), full_waits(0), empty_waits(0) {}
+
+        /// add an item, blocks while the queue is full; false (the item is dropped) when closed
+        bool push(const T& item)
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (items.size() >= capacity) ++full_waits;
+            while (items.size() >= capacity && !closed) cond.wait(lock);
+            if (closed) return false;
+            items.push_back(item);
+            cond.notify_all();
+            return true;
+        }
+
+        /// take an item, blocks while the queue is empty; false when closed and drained
+        bool pop(T& item)
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (items.empty() && producers) ++empty_waits;
+            while (items.empty() && producers && !closed) cond.wait(lock);
+            if (items.empty() || closed) return false;
+            item = items.front();
+            items.pop_front();
+            cond.notify_all();
+            return true;
+        }
+
+        /// a producer will push no more items
+        void done()
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (producers) --producers;
+            cond.notify_all();
+        }
+
+        /// drop queued items and stop all producers and consumers
+        void close()
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            closed = true;
+            items.clear();
+            cond.notify_all();
+        }
+
+        /// number of times a producer waited for free space
+        size_t producer_waits() const { boost::mutex::scoped_lock lock(mutex); return full_waits; }
+        /// number of times a consumer waited for an item
+        size_t consumer_waits() const { boost::mutex::scoped_lock lock(mutex); return empty_waits; }
+
+    private:
+        mutable boost::mutex mutex;
+        boost::condition_variable cond;
+        std::deque<T> items;
+        size_t capacity, producers;
+        bool closed;
+        size_t full_waits, empty_waits;
+};
+
+#endif // QUEUE_HPP_
@@ -0,0 +1,267 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "server.hpp"
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <boost/bind/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+const int POLL_TIMEOUT = 200;           // ms, how often stop requests are checked
+const size_t MAX_LINE = 4096;           // longest request line
+const size_t MAX_PCM_SAMPLES = 1 << 27; // longest PCM request
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) { stop_requested = 1; }
+
+void ClassifierServer::stop() { stop_requested = 1; }
+
+/// wait until a descriptor is readable, false if stop was requested
+static bool wait_readable(int fd)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!stop_requested) {
+        pfd.revents = 0;
+        int r = poll(&pfd, 1, POLL_TIMEOUT);
+        if (r > 0) return true;
+        if (r < 0 && errno != EINTR) return false;
+    }
+    return false;
+}
+
+/// buffered reading from a client connection
+class ServerConnection {
+    public:
+        explicit ServerConnection(int fd) : fd(fd) {}
+
+        /// read a line (without the newline), false on end of input
+        bool read_line(std::string& line)
+        {
+            size_t nl;
+            while ((nl = buf.find('\n')) == std::string::npos) {
+                if (buf.size() > MAX_LINE) throw std::runtime_error("request line too long");
+                if (!fill()) return false;
+            }
+            line = buf.substr(0, nl);
+            if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+            buf.erase(0, nl + 1);
+            return true;
+        }
+
+        /// read exactly @a n bytes
+        bool read(char* data, size_t n)
+        {
+            while (buf.size() < n) {
+                size_t have = buf.size();
+                std::memcpy(data, buf.data(), have);
+                data += have;
+                n -= have;
+                buf.clear();
+                if (!fill()) return false;
+            }
+            std::memcpy(data, buf.data(), n);
+            buf.erase(0, n);
+            return true;
+        }
+
+        /// send a reply line
+        void reply(const std::string& line)
+        {
+            std::string msg = line + "\n";
+            for (size_t done = 0; done < msg.size(); ) {
+                ssize_t r = send(fd, msg.data() + done, msg.size() - done, MSG_NOSIGNAL);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) throw std::runtime_error("connection lost");
+                done += r;
+            }
+        }
+
+    private:
+        bool fill()
+        {
+            char tmp[65536];
+            if (!wait_readable(fd)) return false;
+            ssize_t r = recv(fd, tmp, sizeof(tmp), 0);
+            if (r <= 0) return false;
+            buf.append(tmp, r);
+            return true;
+        }
+
+    private:
+        int fd;
+        std::string buf;
+};
+
+ClassifierServer::ClassifierServer(const Classifier& c, const std::string& socket_path, size_t workers) :
+    cls(c), path(socket_path), listen_fd(-1), n_workers(std::max<size_t>(workers, 1)), n_requests(0)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+
+    // replace a socket left behind by a previous server, but never a regular file
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) throw std::runtime_error("Not a socket: " + path);
+        unlink(path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw std::runtime_error("Unable to create socket");
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+        std::string err = std::strerror(errno);
+        close(listen_fd);
+        throw std::runtime_error("Unable to listen on " + path + ": " + err);
+    }
+}
+
+ClassifierServer::~ClassifierServer()
+{
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+void ClassifierServer::run()
+{
+    stop_requested = 0;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    for (size_t i = 0; i < n_workers; ++i)
+        workers.create_thread(boost::bind(&ClassifierServer::work, this));
+
+    while (wait_readable(listen_fd)) {
+        int fd = accept(listen_fd, 0, 0);
+        if (fd < 0) continue;
+        boost::mutex::scoped_lock lock(mutex);
+        pending.push_back(fd);
+        cond.notify_one();
+    }
+
+    cond.notify_all();
+    workers.join_all();
+    for (size_t i = 0; i < pending.size(); ++i) close(pending[i]);
+    pending.clear();
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+}
+
+void ClassifierServer::work()
+{
+    for (;;) {
+        int fd;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while (pending.empty() && !stop_requested)
+                cond.timed_wait(lock, boost::posix_time::milliseconds(POLL_TIMEOUT));
+            if (stop_requested) return;
+            fd = pending.front();
+            pending.pop_front();
+        }
+        serve(fd);
+        close(fd);
+    }
+}
+
+void ClassifierServer::serve(int fd)
+{
+    ServerConnection conn(fd);
+    std::string line;
+    try {
+        while (conn.read_line(line)) {
+            if (line == "quit") break;
+            std::string reply;
+            try {
+                reply = handle(line, conn);
+            } catch (std::exception& e) {
+                reply = std::string("error ") + e.what();
+            }
+            conn.reply(reply);
+            boost::mutex::scoped_lock lock(mutex);
+            ++n_requests;
+        }
+    } catch (std::exception& e) {
+        // the client went away or sent garbage, drop the connection
+    }
+}
+
+std::string ClassifierServer::handle(const std::string& request, ServerConnection& conn)
+{
+    std::istringstream is(request);
+    std::string cmd;
+    is >> cmd;
+
+    if (cmd == "labels") {
+        std::string reply("ok");
+        for (size_t i = 0; i < cls.labels().size(); ++i) reply += " " + cls.labels()[i];
+        return reply;
+    }
+
+    if (cmd == "classify") {
+        std::string filename;
+        if (!getline(is >> std::ws, filename) || filename.empty()) throw std::runtime_error("file name expected");
+        return classify(filename);
+    }
+
+    if (cmd == "pcm") {
+        unsigned rate;
+        size_t samples;
+        if (!(is >> rate >> samples) || rate == 0) throw std::runtime_error("sample rate and count expected");
+        if (samples > MAX_PCM_SAMPLES) throw std::runtime_error("too many samples");
+        std::vector<char> pcm(2 * samples);
+        if (samples && !conn.read(&pcm[0], pcm.size())) throw std::runtime_error("connection lost");
+        std::vector<short> data(samples);
+        for (size_t i = 0; i < samples; ++i)
+            data[i] = static_cast<short>((static_cast<unsigned char>(pcm[2 * i + 1]) << 8) | static_cast<unsigned char>(pcm[2 * i]));
+
+        // the feature extractor reads wave files only
+        boost::filesystem::path tmp = boost::filesystem::temp_directory_path()
+                                    / boost::filesystem::unique_path("genre-%%%%-%%%%-%%%%.wav");
+        try {
+            Features::write_wave(tmp.string(), rate, data);
+            std::string reply = classify(tmp.string());
+            boost::filesystem::remove(tmp);
+            return reply;
+        } catch (...) {
+            boost::filesystem::remove(tmp);
+            throw;
+        }
+    }
+
+    throw std::runtime_error("unknown request: " + cmd);
+}
+
+std::string ClassifierServer::classify(const std::string& filename)
+{
+    DataSet data;
+    data.load(filename);
+    Classifier::Vector result = cls.exec(data);
+
+    std::ostringstream os;
+    os << "ok " << data.count();
+    for (size_t l = 0; l < cls.labels().size() && l < result.size(); ++l)
+        os << ' ' << cls.labels()[l] << ':' << result(l);
+    return os.str();
+}
@@ -0,0 +1,79 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef SERVER_HPP_
+#define SERVER_HPP_
+
+#include "classifier.hpp"
+#include <deque>
+#include <string>
+#include <boost/utility.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+class ServerConnection;
+
+/**
+ * Classification daemon listening on a Unix domain socket.
+ * The classifier is loaded once and shared by a pool of worker threads,
+ * each serving one client connection at a time.
+ *
+ * Protocol (one request per line, one reply line per request):
+ *   classify <wav_file>     classify a wave file readable by the server
+ *   pcm <rate> <samples>    classify 16-bit mono little-endian PCM data
+ *                           (<samples> * 2 bytes following the request line)
+ *   labels                  list output labels
+ *   quit                    close the connection
+ * Replies are "ok <frames> <label>:<log_score> ..." ("ok <label> ..." for labels)
+ * or "error <message>".
+ */
+class ClassifierServer : boost::noncopyable {
+    public:
+        /**
+         * create the listening socket
+         * @param c classifier to use
+         * @param socket_path socket file name (a stale socket file is replaced)
+         * @param workers number of worker threads (concurrent clients)
+         */
+        explicit ClassifierServer(const Classifier& c, const std::string& socket_path, size_t workers);
+        /// destructor, removes the socket file
+        ~ClassifierServer();
+
+        /// serve clients until SIGINT or SIGTERM is received or stop() is called
+        void run();
+        /// make all running servers stop (safe to call from a signal handler)
+        static void stop();
+
+        /// number of requests served so far
+        size_t requests() const { return n_requests; }
+
+    private:
+        /// worker thread main loop
+        void work();
+        /// serve single client connection
+        void serve(int fd);
+        /// process single request and return the reply
+        std::string handle(const std::string& request, ServerConnection& conn);
+        /// classify a wave file and format the reply
+        std::string classify(const std::string& filename);
+
+    private:
+        const Classifier& cls;
+        std::string path;
+        int listen_fd;
+        size_t n_workers;
+        boost::thread_group workers;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        std::deque<int> pending;   ///< accepted connections waiting for a worker
+        size_t n_requests;
+};
+
+#endif // SERVER_HPP_
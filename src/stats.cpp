@@ -0,0 +1,93 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "stats.hpp"
+#include <stdexcept>
+#include <algorithm>
+
+using boost::numeric::ublas::zero_vector;
+
+RunningStats::RunningStats() : n(0) {}
+
+void RunningStats::clear()
+{
+    n = 0;
+    mean_ = m2_ = FeatureVector();
+}
+
+void RunningStats::add(const FeatureVector& x)
+{
+    if (n == 0) mean_ = m2_ = zero_vector<Real>(x.size());
+    if (x.size() != mean_.size()) throw std::runtime_error("Statistics dimension mismatch.");
+
+    ++n;
+    for (size_t i = 0; i < x.size(); ++i) {
+        Real delta = x(i) - mean_(i);
+        mean_(i) += delta / n;
+        m2_(i) += delta * (x(i) - mean_(i));
+    }
+}
+
+void RunningStats::merge(const RunningStats& s)
+{
+    if (s.n == 0) return;
+    if (n == 0) { *this = s; return; }
+    if (s.size() != size()) throw std::runtime_error("Statistics dimension mismatch.");
+
+    const Real na = n, nb = s.n, nab = na + nb;
+    for (size_t i = 0; i < size(); ++i) {
+        Real delta = s.mean_(i) - mean_(i);
+        mean_(i) += delta * nb / nab;
+        m2_(i) += s.m2_(i) + delta * delta * na * nb / nab;
+    }
+    n += s.n;
+}
+
+FeatureVector RunningStats::variance() const
+{
+    FeatureVector v = m2_;
+    for (size_t i = 0; i < v.size(); ++i) v(i) /= n;
+    return v;
+}
+
+FeatureVector RunningStats::sum() const
+{
+    FeatureVector s = mean_;
+    for (size_t i = 0; i < s.size(); ++i) s(i) *= n;
+    return s;
+}
+
+FeatureVector RunningStats::sumsq() const
+{
+    FeatureVector s = m2_;
+    for (size_t i = 0; i < s.size(); ++i) s(i) += n * mean_(i) * mean_(i);
+    return s;
+}
+
+RunningStats RunningStats::from_moments(size_t n, const FeatureVector& mean, const FeatureVector& m2)
+{
+    RunningStats s;
+    if (n == 0) return s;
+    s.n = n;
+    s.mean_ = mean;
+    s.m2_ = m2;
+    return s;
+}
+
+RunningStats RunningStats::from_sums(size_t n, const FeatureVector& sum, const FeatureVector& sumsq)
+{
+    RunningStats s;
+    if (n == 0 || sum.size() == 0) return s;
+    s.n = n;
+    s.mean_ = s.m2_ = sum;
+    for (size_t i = 0; i < sum.size(); ++i) {
+        s.mean_(i) = sum(i) / n;
+        s.m2_(i) = std::max<Real>(0.0, sumsq(i) - sum(i) * s.mean_(i));
+    }
+    return s;
+}
@@ -0,0 +1,60 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include "common.hpp"
+
+/**
+ * Per-dimension mean and variance of a sequence of vectors.
+ * Samples are accumulated by Welford's method and partial statistics
+ * (e.g. computed per file or per thread) can be merged by Chan's formula,
+ * both without the cancellation of the naive E[x^2]-E[x]^2 approach.
+ */
+class RunningStats {
+    public:
+        /// empty statistics
+        explicit RunningStats();
+
+        /// add a sample
+        void add(const FeatureVector& x);
+        /// merge statistics of another set of samples
+        void merge(const RunningStats& s);
+        /// reset to empty statistics
+        void clear();
+
+        /// number of samples
+        size_t count() const { return n; }
+        /// vector dimension (0 if empty)
+        size_t size() const { return mean_.size(); }
+        /// per-dimension mean
+        const FeatureVector& mean() const { return mean_; }
+        /// per-dimension population variance
+        FeatureVector variance() const;
+        /// sum of squared deviations from the mean
+        const FeatureVector& m2() const { return m2_; }
+
+        /// per-dimension sum of samples
+        FeatureVector sum() const;
+        /// per-dimension sum of squared samples
+        FeatureVector sumsq() const;
+
+        /// construct statistics from count and mean / squared deviations
+        static RunningStats from_moments(size_t n, const FeatureVector& mean, const FeatureVector& m2);
+        /// construct statistics from count, sum and sum of squares (legacy data files)
+        static RunningStats from_sums(size_t n, const FeatureVector& sum, const FeatureVector& sumsq);
+
+    private:
+        size_t n;             ///< sample count
+        FeatureVector mean_;  ///< running mean
+        FeatureVector m2_;    ///< running sum of squared deviations
+};
+
+#endif // STATS_HPP_
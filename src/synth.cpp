@@ -0,0 +1,168 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "synth.hpp"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+
+const Real PI = 3.14159265358979323846;
+const Real MAX_SECONDARY = 0.6;  // weight of the secondary genre is drawn from [0, MAX_SECONDARY)
+const Real PITCH_JITTER = 0.03;  // relative spread of record pitch
+const Real RECORD_SPREAD = 0.5;  // spread of record centers around the genre mix
+const Real FRAME_CORRELATION = 0.8;
+
+Synthesizer::Options::Options() : records(20), length(5.0), rate(22050), dims(30), separation(4.0) {}
+
+Synthesizer::Synthesizer(const Options& opt, unsigned seed) : opt(opt), rng(seed)
+{
+    if (opt.labels.empty()) throw std::runtime_error("No genres to synthesize");
+    if (opt.length <= 0.0 || opt.rate == 0) throw std::runtime_error("Invalid synthetic record length");
+}
+
+// distributions are computed from the raw generator output, whose sequence is fixed
+// for a seed, so that the workload does not depend on the boost version
+
+Real Synthesizer::uniform(Real lo, Real hi)
+{
+    return lo + (hi - lo) * ((rng() + 0.5) / 4294967296.0);
+}
+
+Real Synthesizer::normal()
+{
+    // Box-Muller transform
+    Real u = uniform(0.0, 1.0), v = uniform(0.0, 1.0);
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * PI * v);
+}
+
+Synthesizer::Record Synthesizer::next_record(size_t idx)
+{
+    Record r;
+    size_t n = opt.labels.size();
+    r.primary = idx % n;
+    r.secondary = (n > 1 ? (r.primary + 1 + rng() % (n - 1)) % n : r.primary);
+    r.weight = (n > 1 ? uniform(0.0, MAX_SECONDARY) : 0.0);
+    return r;
+}
+
+AnnotationType Synthesizer::annotations(const Record& r) const
+{
+    AnnotationType a;
+    a[opt.labels[r.primary]] = 100.0;
+    if (r.secondary != r.primary) a[opt.labels[r.secondary]] = std::floor(100.0 * r.weight + 0.5);
+    return a;
+}
+
+std::vector<short> Synthesizer::samples(const Record& r)
+{
+    std::vector<Real> signal(static_cast<size_t>(opt.length * opt.rate), 0.0);
+
+    const size_t genres[2] = { r.primary, r.secondary };
+    const Real weights[2] = { 1.0, r.weight };
+    for (size_t v = 0; v < 2; ++v) {
+        if (weights[v] <= 0.0) continue;
+
+        // the voice of a genre
+        size_t g = genres[v];
+        Real pitch = 80.0 * std::pow(1.5, Real(g)) * std::exp(PITCH_JITTER * normal());
+        size_t harmonics = 2 + 3 * (g % 3);
+        Real decay = 0.4 + 0.15 * (g % 4);
+        Real pulse = 1.5 + 0.75 * g;
+        Real noise = 0.05 * (g % 3);
+
+        std::vector<Real> phase(harmonics), amp(harmonics);
+        for (size_t h = 0; h < harmonics; ++h) {
+            phase[h] = uniform(0.0, 2.0 * PI);
+            amp[h] = std::pow(decay, Real(h));
+        }
+        Real pulse_phase = uniform(0.0, 2.0 * PI);
+
+        for (size_t i = 0; i < signal.size(); ++i) {
+            Real t = Real(i) / opt.rate, s = 0.0;
+            for (size_t h = 0; h < harmonics; ++h)
+                s += amp[h] * std::sin(2.0 * PI * (h + 1) * pitch * t + phase[h]);
+            if (noise > 0.0) s += noise * normal();
+            signal[i] += weights[v] * (0.6 + 0.4 * std::cos(2.0 * PI * pulse * t + pulse_phase)) * s;
+        }
+    }
+
+    Real peak = 1e-9;
+    for (size_t i = 0; i < signal.size(); ++i) peak = std::max(peak, std::fabs(signal[i]));
+    std::vector<short> pcm(signal.size());
+    for (size_t i = 0; i < signal.size(); ++i) pcm[i] = static_cast<short>(16000.0 * signal[i] / peak);
+    return pcm;
+}
+
+std::vector<std::string> Synthesizer::corpus(const std::string& dir)
+{
+    boost::filesystem::create_directories(dir);
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < opt.records; ++i) {
+        char name[32];
+        std::sprintf(name, "synth_%04u", unsigned(i));
+        std::string base = (boost::filesystem::path(dir) / name).string();
+
+        Record r = next_record(i);
+        Features::write_wave(base + ".wav", opt.rate, samples(r));
+
+        std::ofstream ofs((base + ".tag").c_str());
+        AnnotationType a = annotations(r);
+        for (AnnotationType::const_iterator it = a.begin(); it != a.end(); ++it)
+            ofs << it->second << ' ' << it->first << std::endl;
+        if (!ofs) throw std::runtime_error("Unable to write " + base + ".tag");
+        names.push_back(base);
+    }
+    return names;
+}
+
+template <typename Output>
+void Synthesizer::generate(Output& out)
+{
+    const size_t dims = std::max<size_t>(opt.dims, 1);
+    const size_t frames = std::max<size_t>(static_cast<size_t>(opt.length / Features::frame_period()), 2);
+
+    // genre clusters, centers of two genres are about opt.separation apart
+    std::vector<FeatureVector> centers(opt.labels.size(), FeatureVector(dims));
+    Real spread = opt.separation / std::sqrt(2.0 * dims);
+    for (size_t g = 0; g < centers.size(); ++g)
+        for (size_t j = 0; j < dims; ++j) centers[g](j) = spread * normal();
+
+    // raw features are neither centered nor scaled
+    FeatureVector offset(dims), scale(dims);
+    for (size_t j = 0; j < dims; ++j) {
+        offset(j) = 5.0 * normal();
+        scale(j) = std::exp(normal());
+    }
+
+    const Real innovation = std::sqrt(1.0 - FRAME_CORRELATION * FRAME_CORRELATION);
+    FeatureVector x(dims), walk(dims);
+    for (size_t i = 0; i < opt.records; ++i) {
+        Record r = next_record(i);
+        FeatureVector target = DataSet::desired_output(annotations(r), opt.labels);
+        FeatureVector center = (1.0 - r.weight) * centers[r.primary] + r.weight * centers[r.secondary];
+        for (size_t j = 0; j < dims; ++j) {
+            center(j) += RECORD_SPREAD * normal();
+            walk(j) = normal();
+        }
+
+        for (size_t f = 0; f < frames; ++f) {
+            for (size_t j = 0; j < dims; ++j) {
+                walk(j) = FRAME_CORRELATION * walk(j) + innovation * normal();
+                x(j) = offset(j) + scale(j) * (center(j) + walk(j));
+            }
+            out.add_sample(x, target);
+        }
+    }
+}
+
+void Synthesizer::dataset(DataSet& data) { generate(data); }
+
+void Synthesizer::dataset(DataStream::Writer& out) { generate(out); }
@@ -0,0 +1,73 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef SYNTH_HPP_
+#define SYNTH_HPP_
+
+#include "features.hpp"
+#include "datastream.hpp"
+#include <boost/random/mersenne_twister.hpp>
+
+/**
+ * Seeded generator of synthetic corpora and datasets for reproducible
+ * performance runs. The same seed and options always give the same output.
+ *
+ * Every genre is a voice with its own pitch, timbre, noise and pulse rate;
+ * a record mixes its primary genre with a weaker secondary one and the mix
+ * is written to its annotations. Synthetic datasets skip the audio and keep
+ * the structure: genres are clusters, a record is a random point near its
+ * genres and its frames are a correlated walk around that point.
+ */
+class Synthesizer {
+    public:
+        /// workload shape
+        struct Options {
+            LabelList labels;  ///< genres (records cycle through them as primary genre)
+            size_t records;    ///< number of records
+            Real length;       ///< record length in seconds
+            unsigned rate;     ///< sample rate of synthetic records
+            size_t dims;       ///< input size of synthetic datasets
+            Real separation;   ///< distance of genre clusters in frame standard deviations
+
+            /// 20 records, 5 s long, 22050 Hz, 30 dimensions, separation 4
+            Options();
+        };
+
+        /// constructor
+        explicit Synthesizer(const Options& opt, unsigned seed);
+
+        /**
+         * Write records as <dir>/synth_NNNN.wav with .tag annotations.
+         * @return record names without the extension
+         */
+        std::vector<std::string> corpus(const std::string& dir);
+        /// add a synthetic dataset (unnormalized, in record order)
+        void dataset(DataSet& data);
+        /// write a synthetic dataset into a binary stream
+        void dataset(DataStream::Writer& out);
+
+    private:
+        /// genres of a record
+        struct Record {
+            size_t primary, secondary;
+            Real weight;  ///< relative weight of the secondary genre
+        };
+        Record next_record(size_t idx);
+        AnnotationType annotations(const Record& r) const;
+        std::vector<short> samples(const Record& r);
+        template <typename Output> void generate(Output& out);
+        Real uniform(Real lo, Real hi);
+        Real normal();
+
+    private:
+        Options opt;
+        boost::mt19937 rng;
+};
+
+#endif // SYNTH_HPP_
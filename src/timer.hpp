@@ -0,0 +1,23 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef TIMER_HPP_
+#define TIMER_HPP_
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/// wall-clock time in seconds (since the first call)
+inline double wall_time()
+{
+    using namespace boost::posix_time;
+    static const ptime epoch(microsec_clock::universal_time());
+    return (microsec_clock::universal_time() - epoch).total_microseconds() * 1e-6;
+}
+
+#endif // TIMER_HPP_
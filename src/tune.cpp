@@ -0,0 +1,178 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#include "tune.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+Tuner::Options::Options() : threads(1), min_iterations(2), eta(2), xval_sample(0) {}
+
+Tuner::Tuner(const ConfigList& configs, const LabelList& labels, const SampleSource& train,
+             const SampleSource& test, const SampleSource& xval, const Options& opt) :
+    test(test), opt(opt), next(0)
+{
+    if (configs.empty()) throw std::runtime_error("No configurations to tune");
+    this->opt.threads = std::max<size_t>(opt.threads, 1);
+    this->opt.min_iterations = std::max<size_t>(opt.min_iterations, 1);
+    this->opt.eta = std::max<size_t>(opt.eta, 2);
+
+    // networks are initialized here, in order, so that a seeded search is repeatable
+    trials.resize(configs.size());
+    for (size_t i = 0; i < configs.size(); ++i) {
+        Trial& t = trials[i];
+        NeuralNet nn(train.input_size(), configs[i].hidden, train.output_size(), sigmoid_func, logsigmoid_func);
+        t.cls.reset(new Classifier);
+        t.teacher.reset(new Classifier::Teacher(*t.cls, nn, labels, train, test, xval));
+        t.teacher->set_log(0);
+        t.teacher->set_xval_sample(opt.xval_sample);
+        t.started = false;
+        t.result.config = configs[i];
+        t.result.state = RUNNING;
+        t.result.iterations = t.result.rung = 0;
+        t.result.xval_error = 0.0;
+        t.result.test_error = -1.0;
+    }
+}
+
+Tuner::ConfigList Tuner::grid(const std::vector<size_t>& hidden, const std::vector<size_t>& chunks, const std::vector<Real>& rates)
+{
+    ConfigList configs;
+    for (size_t h = 0; h < hidden.size(); ++h)
+        for (size_t c = 0; c < chunks.size(); ++c)
+            for (size_t r = 0; r < rates.size(); ++r) {
+                Config cfg = { hidden[h], chunks[c], rates[r] };
+                configs.push_back(cfg);
+            }
+    return configs;
+}
+
+void Tuner::work(const std::vector<size_t>* active, size_t iterations)
+{
+    for (;;) {
+        size_t idx;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (next >= active->size() || !error.empty()) return;
+            idx = (*active)[next++];
+        }
+        Trial& t = trials[idx];
+        try {
+            if (!t.started) {
+                t.teacher->start(t.result.config.chunk, t.result.config.rate);
+                t.started = true;
+            }
+            for (size_t i = 0; (iterations == 0 || i < iterations) && t.teacher->step() == Classifier::Teacher::RUNNING; ++i) ;
+        } catch (std::exception& e) {
+            boost::mutex::scoped_lock lock(mutex);
+            if (error.empty()) error = e.what();
+        }
+    }
+}
+
+void Tuner::advance(const std::vector<size_t>& active, size_t iterations)
+{
+    next = 0;
+    size_t n = std::min(opt.threads, active.size());
+    if (n <= 1) {
+        work(&active, iterations);
+    } else {
+        boost::thread_group group;
+        for (size_t i = 0; i < n; ++i)
+            group.create_thread(boost::bind(&Tuner::work, this, &active, iterations));
+        group.join_all();
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+}
+
+/// order trials by crossvalidation error
+struct ByError {
+    const std::vector<Tuner::Result>* results;
+    bool operator()(size_t a, size_t b) const { return (*results)[a].xval_error < (*results)[b].xval_error; }
+};
+
+void Tuner::run(std::ostream& log)
+{
+    std::vector<size_t> active(trials.size());
+    for (size_t i = 0; i < active.size(); ++i) active[i] = i;
+
+    size_t iterations = opt.min_iterations;
+    for (size_t rung = 0; !active.empty(); ++rung) {
+        // the last configuration left is trained to the end
+        bool last = (active.size() == 1);
+        advance(active, last ? 0 : iterations);
+
+        std::vector<size_t> running;
+        for (size_t i = 0; i < active.size(); ++i) {
+            Trial& t = trials[active[i]];
+            t.result.iterations = t.teacher->iterations();
+            t.result.xval_error = t.teacher->error();
+            t.result.rung = rung;
+            switch (t.teacher->status()) {
+                case Classifier::Teacher::RUNNING:   running.push_back(active[i]); break;
+                case Classifier::Teacher::CONVERGED: t.result.state = CONVERGED; break;
+                case Classifier::Teacher::FAILED:    t.result.state = FAILED; break;
+            }
+        }
+
+        std::vector<Result> res = results();
+        ByError by_error = { &res };
+        std::sort(running.begin(), running.end(), by_error);
+        size_t keep = (running.size() > 1 ? std::max<size_t>(running.size() / opt.eta, 1) : running.size());
+        for (size_t i = keep; i < running.size(); ++i) trials[running[i]].result.state = STOPPED;
+        running.resize(keep);
+
+        log << "--- Round " << (rung + 1) << ": " << active.size() << " configurations, "
+            << (last ? std::string("until converged") : boost::lexical_cast<std::string>(iterations) + " iterations")
+            << ", " << running.size() << " kept";
+        if (!running.empty()) log << " (best xval error " << trials[running[0]].result.xval_error << ")";
+        log << std::endl;
+
+        active = running;
+        iterations *= opt.eta;
+    }
+
+    // converged configurations compete on the test set
+    for (size_t i = 0; i < trials.size(); ++i)
+        if (trials[i].result.state == CONVERGED)
+            trials[i].result.test_error = trials[i].teacher->test_error();
+}
+
+std::vector<Tuner::Result> Tuner::results() const
+{
+    std::vector<Result> res;
+    for (size_t i = 0; i < trials.size(); ++i) res.push_back(trials[i].result);
+    return res;
+}
+
+size_t Tuner::best() const
+{
+    size_t best = trials.size();
+    for (size_t i = 0; i < trials.size(); ++i) {
+        const Result& r = trials[i].result;
+        if (r.state == CONVERGED && (best == trials.size() || r.test_error < trials[best].result.test_error)) best = i;
+    }
+    if (best == trials.size()) throw std::runtime_error("No configuration converged");
+    return best;
+}
+
+void Tuner::write_table(std::ostream& os) const
+{
+    static const char* states[] = { "running", "converged", "failed", "stopped" };
+    os << "#\thidden\tchunk\trate\titer\tround\txval_error\ttest_error\tstate" << std::endl;
+    for (size_t i = 0; i < trials.size(); ++i) {
+        const Result& r = trials[i].result;
+        os << (i + 1) << '\t' << r.config.hidden << '\t' << r.config.chunk << '\t' << r.config.rate << '\t'
+           << r.iterations << '\t' << (r.rung + 1) << '\t' << r.xval_error << '\t';
+        if (r.test_error >= 0.0) os << r.test_error;
+        else os << '-';
+        os << '\t' << states[r.state] << std::endl;
+    }
+}
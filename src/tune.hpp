@@ -0,0 +1,115 @@
+/*
+ * SFC project (2010) - music genre classifier
+ * by Lukas Kuklinek <xkukli01@stud.fit.vutbr.cz>
+ * Faculty of Information Tachnology
+ * Brno University of Technology
+ */
+
+
+#pragma once
+#ifndef TUNE_HPP_
+#define TUNE_HPP_
+
+#include "classifier.hpp"
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Concurrent hyperparameter search with successive halving.
+ * All configurations are trained for a few New Bob iterations, then only
+ * the better part of them (by crossvalidation error) is trained further
+ * for more iterations, and so on until a single one is left, which is
+ * trained until New Bob stops it. Configurations may stop on their own
+ * at any time, converged ones are candidates for the best classifier.
+ */
+class Tuner : boost::noncopyable {
+    public:
+        /// training hyperparameters
+        struct Config {
+            size_t hidden;  ///< hidden neurons
+            size_t chunk;   ///< samples presented at a time
+            Real rate;      ///< initial learning rate
+        };
+        typedef std::vector<Config> ConfigList;
+
+        /// state of a configuration
+        enum State {
+            RUNNING,   ///< still being trained
+            CONVERGED, ///< New Bob training finished
+            FAILED,    ///< New Bob training failed
+            STOPPED    ///< terminated by successive halving
+        };
+
+        /// outcome of a configuration
+        struct Result {
+            Config config;
+            State state;
+            size_t iterations; ///< New Bob iterations done
+            size_t rung;       ///< last halving round the configuration took part in
+            Real xval_error;   ///< crossvalidation error when the training ended
+            Real test_error;   ///< test error (converged configurations only, -1 otherwise)
+        };
+
+        /// search settings
+        struct Options {
+            size_t threads;        ///< configurations trained at once
+            size_t min_iterations; ///< iterations of the first round
+            size_t eta;            ///< fraction of configurations kept (1/eta) and growth of iterations per round
+            size_t xval_sample;    ///< crossvalidation subsample size (0 = whole set)
+
+            /// one thread, two iterations, halving, whole crossvalidation set
+            Options();
+        };
+
+    public:
+        /**
+         * constructor, initializes networks of all configurations
+         * @param configs configurations to try
+         * @param labels output labels
+         * @param train training data set
+         * @param test testing data set (selects the best converged configuration)
+         * @param xval crossvalidation data set (controls training and halving)
+         * @param opt search settings
+         */
+        explicit Tuner(const ConfigList& configs, const LabelList& labels, const SampleSource& train,
+                       const SampleSource& test, const SampleSource& xval, const Options& opt = Options());
+
+        /// run the search, progress of rounds is written to @a log
+        void run(std::ostream& log);
+        /// results of all configurations
+        std::vector<Result> results() const;
+        /// index of the best converged configuration
+        size_t best() const;
+        /// trained classifier of a configuration
+        const Classifier& classifier(size_t i) const { return *trials[i].cls; }
+        /// write results as a table
+        void write_table(std::ostream& os) const;
+
+        /// all combinations of hyperparameter values
+        static ConfigList grid(const std::vector<size_t>& hidden, const std::vector<size_t>& chunks, const std::vector<Real>& rates);
+
+    private:
+        /// configuration being trained
+        struct Trial {
+            boost::shared_ptr<Classifier> cls;
+            boost::shared_ptr<Classifier::Teacher> teacher;
+            Result result;
+            bool started;
+        };
+
+        /// train given trials for up to @a iterations (unlimited if 0) concurrently
+        void advance(const std::vector<size_t>& active, size_t iterations);
+        /// worker thread body
+        void work(const std::vector<size_t>* active, size_t iterations);
+
+    private:
+        const SampleSource& test;
+        Options opt;
+        std::vector<Trial> trials;
+        size_t next;        ///< next trial of advance() to take
+        std::string error;  ///< first error of a worker
+        boost::mutex mutex;
+};
+
+#endif // TUNE_HPP_